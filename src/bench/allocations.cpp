@@ -0,0 +1,104 @@
+#include "bench.hpp"
+
+#include <malloc.h>
+#include <sys/resource.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global allocation functions to count every heap allocation
+// of the process, the library and boost included
+
+namespace {
+
+std::atomic<long long> g_allocations{0};
+thread_local long long t_allocations = 0;
+
+void count() {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    ++t_allocations;
+}
+
+void* allocate(std::size_t size) {
+    count();
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept {
+    count();
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept {
+    count();
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::nothrow_t const&) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::nothrow_t const&) noexcept {
+    std::free(p);
+}
+
+namespace bench {
+
+long long allocations() {
+    return g_allocations.load(std::memory_order_relaxed);
+}
+
+long long thread_allocations() {
+    return t_allocations;
+}
+
+double cpu_ns() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    auto ns = [](timeval const& t) {
+        return static_cast<double>(t.tv_sec) * 1e9 +
+               static_cast<double>(t.tv_usec) * 1e3;
+    };
+    return ns(usage.ru_utime) + ns(usage.ru_stime);
+}
+
+long long heap_bytes() {
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return static_cast<long long>(mallinfo2().uordblks);
+#else
+    return 0;
+#endif
+}
+
+}  // namespace bench
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+struct result {
+    result(std::string n, std::size_t i, double ns, double allocs,
+           double bytes = 0)
+        : name(std::move(n)),
+          iterations(i),
+          ns_per_op(ns),
+          allocations_per_op(allocs),
+          bytes_per_op(bytes) {}
+
+    std::string name;
+    std::size_t iterations;
+    double ns_per_op;
+    double allocations_per_op;
+    // memory held by each op, only reported when measured
+    double bytes_per_op;
+};
+
+// heap allocations made by the process so far
+long long allocations();
+// heap allocations made by the calling thread so far
+long long thread_allocations();
+// user and system time of the process so far, in nanoseconds
+double cpu_ns();
+// bytes allocated from the heap of the main thread and not freed yet, zero
+// when the allocator does not tell
+long long heap_bytes();
+
+// keeps the optimizer from discarding a computed value
+template <typename T>
+void do_not_optimize(T const& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+template <typename Function>
+result run(std::string name, std::size_t iterations, Function&& f) {
+    using clock = std::chrono::steady_clock;
+
+    // warm up caches and allocators before measuring
+    for (std::size_t i = 0; i < iterations / 10; ++i) {
+        f(i);
+    }
+
+    auto allocs = allocations();
+    auto start = clock::now();
+    for (std::size_t i = 0; i < iterations; ++i) {
+        f(i);
+    }
+    auto elapsed = clock::now() - start;
+    allocs = allocations() - allocs;
+
+    auto ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    return {std::move(name), iterations, ns / iterations,
+            static_cast<double>(allocs) / iterations};
+}
+
+// prints the result and keeps it for the JSON output
+void report(result const& r);
+
+// prints a failed check, the benchmarks then exit with a failure
+void check(bool passed, std::string const& what);
+bool checks_passed();
+
+// every reported result, in report order, as a JSON document
+void write_json(std::ostream& out);
+
+// write family syscalls issued by the process so far
+long long write_syscalls();
+// read family syscalls issued by the calling thread so far
+long long read_syscalls();
+
+// share of the filter levels replaced by wildcards
+struct wildcard_mix {
+    char const* name;
+    int plus_percent;
+    int hash_percent;
+};
+
+struct topic_set {
+    std::vector<std::string> filters;
+    std::vector<std::string> topics;
+};
+
+// unique filters of depth 2 to 6 out of a small level vocabulary, and
+// concrete topics out of the same levels; the same arguments always give
+// the same set
+topic_set make_topic_set(std::size_t filter_count, std::size_t topic_count,
+                         wildcard_mix mix);
+
+extern wildcard_mix const exact_mix;
+extern wildcard_mix const mixed_mix;
+extern wildcard_mix const wild_mix;
+
+void topic_tree_benchmarks();
+void dispatcher_benchmarks();
+void signal_benchmarks();
+// inbound messages with their buffers from the heap and from a pool
+void message_benchmarks();
+void timer_benchmarks();
+// the completions of a read, a post and a write per message, with their
+// storage from the default asio allocation and from a handler_allocator
+void handler_benchmarks();
+// slow handlers run inline on the client strand and offloaded to a pool
+void offload_benchmarks();
+// round trips and batches awaited from a C++20 coroutine, against the
+// loopback broker; only run when built with MOSQUITTOASIO_COROUTINES
+void coroutine_benchmarks();
+// thousands of clients on one io_service, connected to a loopback broker
+// running in a child process
+void fleet_benchmarks(std::vector<std::size_t> const& sizes);
+// the full client and dispatcher stack against the loopback broker, with
+// the given latency injected by the broker
+void loopback_benchmarks(std::chrono::microseconds latency);
+// needs a broker accepting anonymous connections
+void publish_benchmarks(char const* host, int port);
+
+}  // namespace bench
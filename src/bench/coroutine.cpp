@@ -0,0 +1,142 @@
+// boost 1.74 awaitable.hpp uses std::exchange without including it
+#include <utility>
+
+#include "bench.hpp"
+
+#include <boost/asio.hpp>
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+
+#include "mosquitto_asio/coroutine.hpp"
+#include "mosquitto_asio/dispatcher.hpp"
+#include "mosquitto_asio/loopback_broker.hpp"
+
+#include <thread>
+
+namespace bench {
+namespace {
+
+using clock = std::chrono::steady_clock;
+namespace coro = mosquittoasio::coro;
+
+constexpr std::size_t round_trips = 2000;
+constexpr std::size_t batches = 200;
+constexpr std::size_t batch_size = 64;
+
+coro::awaitable<void> run_benchmarks(mosquittoasio::client& client,
+                                     mosquittoasio::receiver& receiver,
+                                     unsigned short port) {
+    auto& io = client.io();
+    co_await coro::connect(client, "127.0.0.1", port, 60);
+
+    // the subscription is in place once a probe comes back
+    while (!receiver.size()) {
+        co_await coro::publish(client, "bench/coroutine/probe", "", 1);
+        boost::asio::steady_timer timer{io, std::chrono::milliseconds(10)};
+        co_await timer.async_wait(boost::asio::use_awaitable);
+    }
+    mosquittoasio::message msg;
+    while (receiver.try_receive(msg)) {
+    }
+
+    auto payload = std::string(64, 'x');
+
+    // one message in flight at a time, the same as e2e/asio/qos0/rtt
+    auto allocs = allocations();
+    auto start = clock::now();
+    for (std::size_t i = 0; i < round_trips; ++i) {
+        co_await coro::publish(client, "bench/coroutine/rtt", payload, 0);
+        msg = co_await coro::receive(receiver);
+    }
+    auto elapsed = clock::now() - start;
+    allocs = allocations() - allocs;
+    auto ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    report({"coroutine/qos0/rtt", round_trips, ns / round_trips,
+            static_cast<double>(allocs) / round_trips});
+
+    // batches published corked, each awaited for its first message and
+    // drained of the ones queued meanwhile
+    allocs = allocations();
+    start = clock::now();
+    for (std::size_t i = 0; i < batches; ++i) {
+        {
+            mosquittoasio::publish_batch batch{client};
+            for (std::size_t j = 0; j < batch_size; ++j) {
+                client.publish("bench/coroutine/batch", payload, 0);
+            }
+        }
+        std::size_t received = 0;
+        while (received < batch_size) {
+            msg = co_await coro::receive(receiver);
+            ++received;
+            while (received < batch_size && receiver.try_receive(msg)) {
+                ++received;
+            }
+        }
+    }
+    elapsed = clock::now() - start;
+    allocs = allocations() - allocs;
+    auto count = batches * batch_size;
+    ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    report({"coroutine/qos0/batched", count, ns / count,
+            static_cast<double>(allocs) / count});
+}
+
+}  // namespace
+
+void coroutine_benchmarks() {
+    boost::asio::io_service broker_io;
+    mosquittoasio::mqtt::loopback_broker broker{broker_io};
+    boost::asio::io_service::work work{broker_io};
+    std::thread broker_thread{[&broker_io] { broker_io.run(); }};
+
+    {
+        boost::asio::io_service io;
+        mosquittoasio::client client{io, "mosquitto-asio-bench", true,
+                                     mosquittoasio::client::backend::asio};
+        mosquittoasio::dispatcher dispatcher{client};
+        // deep enough for a whole batch
+        auto receiver =
+            dispatcher.receive("bench/coroutine/#", 0, 2 * batch_size);
+
+        boost::asio::co_spawn(
+            io, run_benchmarks(client, receiver, broker.port()),
+            [&io](std::exception_ptr e) {
+                if (e) {
+                    try {
+                        std::rethrow_exception(e);
+                    } catch (std::exception const& ex) {
+                        std::cerr << "coroutine: " << ex.what()
+                                  << ", skipped\n";
+                    }
+                }
+                io.stop();
+            });
+        // the connection is retried forever, give up on a stuck broker
+        boost::asio::steady_timer timeout{io, std::chrono::seconds(30)};
+        timeout.async_wait([&io](boost::system::error_code ec) {
+            if (!ec) {
+                std::cerr << "coroutine: timed out, skipped\n";
+                io.stop();
+            }
+        });
+        io.run();
+    }
+
+    broker_io.stop();
+    broker_thread.join();
+}
+
+}  // namespace bench
+
+#else
+
+namespace bench {
+
+void coroutine_benchmarks() {
+    std::cerr << "coroutine: built without C++20 coroutines, skipped\n";
+}
+
+}  // namespace bench
+
+#endif
@@ -0,0 +1,140 @@
+#include "bench.hpp"
+
+#include "mosquitto_asio/client.hpp"
+#include "mosquitto_asio/dispatcher.hpp"
+
+#include <cstdlib>
+#include <vector>
+
+namespace bench {
+namespace {
+
+constexpr std::size_t topic_count = 1024;
+
+void dispatcher_benchmarks(std::size_t count, wildcard_mix mix) {
+    auto set = make_topic_set(count, topic_count, mix);
+    auto suffix = std::string{"/"} + mix.name + "/" + std::to_string(count);
+
+    // never connected, subscribing and unsubscribing send no packets
+    boost::asio::io_service io;
+    mosquittoasio::client client{io};
+    mosquittoasio::dispatcher dispatcher{client};
+
+    std::size_t calls = 0;
+    auto handler = [&calls](mosquittoasio::message const&) { ++calls; };
+
+    std::vector<mosquittoasio::subscription> subscriptions;
+    subscriptions.reserve(count);
+    for (auto const& filter : set.filters) {
+        subscriptions.push_back(dispatcher.subscribe(filter, 0, handler));
+    }
+
+    std::vector<mosquittoasio::message> messages;
+    for (auto const& topic : set.topics) {
+        messages.emplace_back(topic, "payload", 0, false, 0);
+    }
+
+    // the messages go through the client signal, as if read from the socket
+    report(run("dispatch/cached" + suffix, 200000, [&](std::size_t i) {
+        client.message_received_signal(messages[i % topic_count]);
+    }));
+
+    // new filters, each one invalidating the topics it matches
+    std::vector<std::string> churn;
+    for (std::size_t i = 0; i < 256; ++i) {
+        churn.push_back(set.filters[i % count] + "/churn");
+    }
+    report(run("subscribe_unsubscribe" + suffix, 20000, [&](std::size_t i) {
+        {
+            auto s = dispatcher.subscribe(churn[i % churn.size()], 0, handler);
+        }
+        // runs the posted erase
+        io.poll();
+        io.reset();
+    }));
+
+    dispatcher.set_match_cache_size(0);
+    report(run("dispatch/uncached" + suffix, 200000, [&](std::size_t i) {
+        client.message_received_signal(messages[i % topic_count]);
+    }));
+    do_not_optimize(calls);
+
+    subscriptions.clear();
+    io.poll();
+}
+
+// 16 numbers as text, parsed as a JSON or schema payload would be
+std::vector<double> parse(mosquittoasio::message const& msg) {
+    auto text = msg.payload().to_string();
+    std::vector<double> values;
+    auto p = text.c_str();
+    char* end = nullptr;
+    for (auto v = std::strtod(p, &end); end != p; v = std::strtod(p, &end)) {
+        values.push_back(v);
+        p = *end ? end + 1 : end;
+    }
+    return values;
+}
+
+// several subscriptions matching each message, parsing the payload in each
+// handler against a typed subscription decoding it once for all
+void decode_benchmarks(std::size_t subscribers) {
+    using values = std::vector<double>;
+
+    boost::asio::io_service io;
+    mosquittoasio::client client{io};
+    mosquittoasio::dispatcher dispatcher{client};
+    dispatcher.set_decoder<values>(parse);
+
+    std::string payload;
+    for (int i = 0; i < 16; ++i) {
+        payload += std::to_string(i * 1.25) + ",";
+    }
+    auto suffix = "/" + std::to_string(subscribers);
+    double sum = 0;
+
+    std::vector<mosquittoasio::subscription> subscriptions;
+    for (std::size_t i = 0; i < subscribers; ++i) {
+        subscriptions.push_back(dispatcher.subscribe(
+            "bench/decode/#", 0, [&sum](mosquittoasio::message const& msg) {
+                sum += parse(msg).back();
+            }));
+    }
+    report(run("dispatch/decode/each" + suffix, 100000, [&](std::size_t) {
+        client.message_received_signal(mosquittoasio::message{
+            "bench/decode/topic", payload, 0, false, 0});
+    }));
+
+    subscriptions.clear();
+    io.poll();
+    for (std::size_t i = 0; i < subscribers; ++i) {
+        subscriptions.push_back(dispatcher.subscribe<values>(
+            "bench/decode/#", 0,
+            [&sum](mosquittoasio::message const&, values const& v) {
+                sum += v.back();
+            }));
+    }
+    report(run("dispatch/decode/once" + suffix, 100000, [&](std::size_t) {
+        client.message_received_signal(mosquittoasio::message{
+            "bench/decode/topic", payload, 0, false, 0});
+    }));
+    do_not_optimize(sum);
+
+    subscriptions.clear();
+    io.poll();
+}
+
+}  // namespace
+
+void dispatcher_benchmarks() {
+    for (std::size_t count : {10, 100, 1000, 10000, 100000}) {
+        dispatcher_benchmarks(count, mixed_mix);
+    }
+    dispatcher_benchmarks(10000, exact_mix);
+    dispatcher_benchmarks(10000, wild_mix);
+    for (std::size_t subscribers : {1, 4}) {
+        decode_benchmarks(subscribers);
+    }
+}
+
+}  // namespace bench
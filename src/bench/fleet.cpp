@@ -0,0 +1,194 @@
+#include "bench.hpp"
+
+#include "mosquitto_asio/client.hpp"
+#include "mosquitto_asio/loopback_broker.hpp"
+
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <memory>
+
+namespace bench {
+namespace {
+
+using clock = std::chrono::steady_clock;
+using backend = mosquittoasio::client::backend;
+
+// every client takes a descriptor, so does its broker side
+std::size_t raise_descriptor_limit() {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit)) {
+        return 0;
+    }
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+    return static_cast<std::size_t>(limit.rlim_cur);
+}
+
+// the broker runs in a child process so that neither its memory nor its
+// time are counted; returns its pid, or -1
+pid_t fork_broker(unsigned short& port) {
+    int fds[2];
+    if (pipe(fds)) {
+        return -1;
+    }
+    auto pid = fork();
+    if (pid == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        close(fds[0]);
+        boost::asio::io_service io;
+        mosquittoasio::mqtt::loopback_broker broker{io};
+        auto p = broker.port();
+        if (write(fds[1], &p, sizeof(p)) != sizeof(p)) {
+            _exit(EXIT_FAILURE);
+        }
+        close(fds[1]);
+        io.run();
+        _exit(EXIT_SUCCESS);
+    }
+    close(fds[1]);
+    if (pid > 0 && read(fds[0], &port, sizeof(port)) != sizeof(port)) {
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        pid = -1;
+    }
+    close(fds[0]);
+    return pid;
+}
+
+std::size_t count_connected(
+    std::vector<std::unique_ptr<mosquittoasio::client>> const& clients) {
+    std::size_t n = 0;
+    for (auto const& c : clients) {
+        n += c->is_connected();
+    }
+    return n;
+}
+
+void fleet_benchmark(std::string const& name, backend b, std::size_t size,
+                     unsigned short port) {
+    auto prefix = "fleet/" + name + "/" + std::to_string(size);
+
+    boost::asio::io_service io;
+    // creates the services of the io_service before measuring
+    { mosquittoasio::client warm{io, "fleet-warm", true, b}; }
+
+    auto heap = heap_bytes();
+    auto allocs = allocations();
+    auto start = clock::now();
+    std::vector<std::unique_ptr<mosquittoasio::client>> clients;
+    clients.reserve(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        auto id = "fleet-" + std::to_string(i);
+        clients.emplace_back(new mosquittoasio::client{io, id.c_str(), true, b});
+    }
+    auto ns = std::chrono::duration<double, std::nano>(clock::now() - start)
+                  .count();
+    auto n = static_cast<double>(size);
+    report({prefix + "/construct", size, ns / n,
+            static_cast<double>(allocations() - allocs) / n,
+            static_cast<double>(heap_bytes() - heap) / n});
+
+#if MOSQUITTOASIO_STUB_MOSQUITTO
+    // the stub libmosquitto cannot connect, its handle is a few bytes
+    // instead of the couple of kilobytes of libmosquitto
+    if (b == backend::native) {
+        return;
+    }
+#endif
+
+    allocs = allocations();
+    start = clock::now();
+    for (auto& c : clients) {
+        c->connect("127.0.0.1", port, 60);
+    }
+    auto deadline = start + std::chrono::seconds(30);
+    auto connected = std::size_t{0};
+    while ((connected = count_connected(clients)) < size &&
+           clock::now() < deadline) {
+        io.run_for(std::chrono::milliseconds(50));
+    }
+    if (connected < size) {
+        std::cerr << prefix << ": " << connected << " of " << size
+                  << " clients connected, skipped\n";
+        return;
+    }
+    ns = std::chrono::duration<double, std::nano>(clock::now() - start)
+             .count();
+    report({prefix + "/connect", size, ns / n,
+            static_cast<double>(allocations() - allocs) / n,
+            static_cast<double>(heap_bytes() - heap) / n});
+
+    // idle: the cpu time of each client and second, and the wake ups of
+    // the timer wheel shared by their keep alive deadlines
+    constexpr auto seconds = 2;
+    auto& wheel = boost::asio::use_service<mosquittoasio::timer_wheel>(io);
+    auto wakeups = wheel.wakeups();
+    auto cpu = cpu_ns();
+    io.run_for(std::chrono::seconds(seconds));
+    report({prefix + "/idle", size, (cpu_ns() - cpu) / n / seconds, 0,
+            static_cast<double>(heap_bytes() - heap) / n});
+    std::cout << "  wheel wake ups/s: "
+              << (wheel.wakeups() - wakeups) / seconds << '\n';
+
+    // active: every client publishes a message each second, spread over
+    // 10 ms ticks; the cpu time of each message
+    constexpr std::size_t ticks = 100;
+    auto payload = std::string(64, 'x');
+    std::vector<std::string> topics;
+    topics.reserve(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        topics.push_back("fleet/" + std::to_string(i) + "/telemetry");
+    }
+
+    allocs = allocations();
+    cpu = cpu_ns();
+    auto next = clock::now();
+    for (std::size_t tick = 0; tick < ticks * seconds; ++tick) {
+        auto first = tick % ticks * size / ticks;
+        auto last = (tick % ticks + 1) * size / ticks;
+        for (auto i = first; i < last; ++i) {
+            clients[i]->publish(topics[i].c_str(), payload, 0);
+        }
+        next += std::chrono::milliseconds(1000 / ticks);
+        io.run_until(next);
+    }
+    auto messages = static_cast<double>(size * seconds);
+    report({prefix + "/active", size * seconds, (cpu_ns() - cpu) / messages,
+            static_cast<double>(allocations() - allocs) / messages,
+            static_cast<double>(heap_bytes() - heap) / n});
+}
+
+}  // namespace
+
+void fleet_benchmarks(std::vector<std::size_t> const& sizes) {
+    auto descriptors = raise_descriptor_limit();
+
+    unsigned short port = 0;
+    auto broker = fork_broker(port);
+    if (broker < 0) {
+        std::cerr << "fleet: could not start the broker, skipped\n";
+        return;
+    }
+
+    for (auto size : sizes) {
+        // a few descriptors are left for the process itself
+        if (size + 64 > descriptors) {
+            std::cerr << "fleet/" << size << ": needs " << size + 64
+                      << " descriptors, the limit is " << descriptors
+                      << ", skipped\n";
+            continue;
+        }
+        fleet_benchmark("asio", backend::asio, size, port);
+        fleet_benchmark("native", backend::native, size, port);
+    }
+
+    kill(broker, SIGKILL);
+    waitpid(broker, nullptr, 0);
+}
+
+}  // namespace bench
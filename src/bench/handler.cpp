@@ -0,0 +1,224 @@
+#include "bench.hpp"
+
+#include "mosquitto_asio/client.hpp"
+#include "mosquitto_asio/dispatcher.hpp"
+#include "mosquitto_asio/handler_allocator.hpp"
+#include "mosquitto_asio/loopback_broker.hpp"
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace bench {
+namespace {
+
+using error_code = boost::system::error_code;
+using socket_type = boost::asio::local::stream_protocol::socket;
+
+struct default_storage {
+    template <typename Handler>
+    Handler operator()(Handler h) const {
+        return h;
+    }
+};
+
+struct recycled_storage {
+    std::shared_ptr<mosquittoasio::handler_allocator> allocator;
+
+    template <typename Handler>
+    mosquittoasio::allocating_handler<Handler> operator()(Handler h) const {
+        return mosquittoasio::make_allocating_handler(allocator,
+                                                      std::move(h));
+    }
+};
+
+// a byte goes back and forth over a socket pair, its arrival is posted to
+// be delivered and the delivery writes the next one: the handlers a client
+// goes through for each message, on a strand as well
+template <typename Bind>
+class ping_pong {
+   public:
+    ping_pong(boost::asio::io_service& io, Bind bind)
+        : io_(io), strand_(io), writer_(io), reader_(io), bind_(std::move(bind)) {
+        boost::asio::local::connect_pair(writer_, reader_);
+    }
+
+    void run(std::size_t count) {
+        left_ = count;
+        await_read();
+        write();
+        io_.run();
+        io_.restart();
+    }
+
+   private:
+    void await_read() {
+        reader_.async_read_some(
+            boost::asio::buffer(in_),
+            strand_.wrap(bind_([this](error_code ec, std::size_t) {
+                if (ec) {
+                    return;
+                }
+                strand_.post(bind_([this] { deliver(); }));
+                if (left_ > 1) {
+                    await_read();
+                }
+            })));
+    }
+
+    void deliver() {
+        if (--left_) {
+            write();
+        }
+    }
+
+    void write() {
+        boost::asio::async_write(
+            writer_, boost::asio::buffer(out_),
+            strand_.wrap(bind_([](error_code, std::size_t) {})));
+    }
+
+    boost::asio::io_service& io_;
+    boost::asio::io_service::strand strand_;
+    socket_type writer_;
+    socket_type reader_;
+    Bind bind_;
+    std::size_t left_{0};
+    char in_[1];
+    char out_[1] = {'x'};
+};
+
+template <typename Bind>
+void ping_pong_benchmark(std::string const& name, Bind bind) {
+    constexpr std::size_t count = 100000;
+    boost::asio::io_service io;
+    ping_pong<Bind> p{io, std::move(bind)};
+    p.run(count / 10);
+
+    auto allocs = allocations();
+    auto start = std::chrono::steady_clock::now();
+    p.run(count);
+    auto ns = std::chrono::duration<double, std::nano>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+    report({name, count, ns / count,
+            static_cast<double>(allocations() - allocs) / count});
+}
+
+// A client of the asio backend receiving from a loopback broker the messages
+// a second client publishes from a thread of its own, a window of them in
+// flight at a time. Once warmed up, neither client takes handler storage
+// from the heap, nor does the thread of the receiving one allocate
+// anything; the publishing one still allocates each packet it encodes.
+void check_steady_state() {
+    using mosquittoasio::client;
+
+    boost::asio::io_service broker_io;
+    mosquittoasio::mqtt::loopback_broker broker{broker_io};
+    boost::asio::io_service::work broker_work{broker_io};
+    std::thread broker_thread{[&broker_io] { broker_io.run(); }};
+
+    boost::asio::io_service io;
+    client receiving{io, "handler-receiving", true, client::backend::asio};
+    receiving.enable_buffer_pool();
+    mosquittoasio::dispatcher dispatcher{receiving};
+    std::atomic<std::size_t> received{0};
+    auto subscription = dispatcher.subscribe(
+        "bench/handler/#", 0, [&received](mosquittoasio::message const&) {
+            received.fetch_add(1, std::memory_order_relaxed);
+        });
+
+    boost::asio::io_service publisher_io;
+    client publishing{publisher_io, "handler-publishing", true,
+                      client::backend::asio};
+
+    // the client logs every packet, keep it out of the output
+    auto buffer = std::cout.rdbuf(nullptr);
+
+    constexpr std::size_t warm_up = 20000;
+    constexpr std::size_t count = 50000;
+    constexpr std::size_t window = 16;
+    std::atomic<std::size_t> target{0};
+    std::atomic<bool> stop{false};
+    std::thread publisher_thread{[&] {
+        boost::asio::io_service::work work{publisher_io};
+        publishing.connect("127.0.0.1", broker.port(), 60);
+        auto payload = std::string(64, 'x');
+        std::size_t sent = 0;
+        while (!stop) {
+            publisher_io.poll();
+            if (!publishing.is_connected()) {
+                continue;
+            }
+            // probes until the subscription is in place, then keeps the
+            // window full up to the target
+            if (!sent) {
+                publishing.publish("bench/handler/probe", payload, 0);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                sent = received;
+                continue;
+            }
+            if (sent < std::min(target.load(), received.load() + window)) {
+                publishing.publish("bench/handler/steady", payload, 0);
+                ++sent;
+            }
+        }
+    }};
+
+    receiving.connect("127.0.0.1", broker.port(), 60);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    auto run_to = [&](std::size_t messages) {
+        target = messages;
+        while (received < messages) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            io.run_one_for(std::chrono::milliseconds(10));
+        }
+        return true;
+    };
+
+    auto warmed = run_to(warm_up);
+    auto handler_allocs = receiving.allocator().heap_allocations() +
+                          publishing.allocator().heap_allocations();
+    auto thread_allocs = thread_allocations();
+    auto done = warmed && run_to(received + count);
+    handler_allocs = receiving.allocator().heap_allocations() +
+                     publishing.allocator().heap_allocations() -
+                     handler_allocs;
+    thread_allocs = thread_allocations() - thread_allocs;
+
+    stop = true;
+    publisher_thread.join();
+    broker_io.stop();
+    broker_thread.join();
+    std::cout.rdbuf(buffer);
+
+    check(done, "steady state messages were received through the loopback "
+                "broker");
+    if (!done) {
+        return;
+    }
+    check(handler_allocs == 0,
+          "the clients took no handler storage from the heap in steady state");
+    check(thread_allocs == 0,
+          "the receiving client thread allocated nothing in steady state");
+    std::cout << "handler/steady_state: " << handler_allocs
+              << " handler and " << thread_allocs
+              << " thread heap allocations over " << count << " messages\n";
+}
+
+}  // namespace
+
+void handler_benchmarks() {
+    ping_pong_benchmark("handler/ping_pong/default", default_storage{});
+    ping_pong_benchmark(
+        "handler/ping_pong/recycled",
+        recycled_storage{
+            std::make_shared<mosquittoasio::handler_allocator>()});
+    check_steady_state();
+}
+
+}  // namespace bench
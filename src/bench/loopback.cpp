@@ -0,0 +1,175 @@
+#include "bench.hpp"
+
+#include "mosquitto_asio/client.hpp"
+#include "mosquitto_asio/dispatcher.hpp"
+#include "mosquitto_asio/loopback_broker.hpp"
+#include "mosquitto_asio/metrics.hpp"
+
+#include <thread>
+
+namespace bench {
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+// runs the handlers until the condition holds, false on timeout
+template <typename Condition>
+bool run_until(boost::asio::io_service& io, Condition&& done,
+               std::chrono::seconds timeout = std::chrono::seconds(10)) {
+    auto deadline = clock::now() + timeout;
+    while (!done()) {
+        if (clock::now() > deadline) {
+            return false;
+        }
+        io.run_one_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+// an outbound buffer already full when connecting must not keep the
+// connection from completing
+void check_connect_with_full_buffer(
+    unsigned short port, mosquittoasio::client::overflow_policy policy,
+    std::string const& name) {
+    boost::asio::io_service io;
+    mosquittoasio::client client{io, "mosquitto-asio-bench", true,
+                                 mosquittoasio::client::backend::asio};
+    mosquittoasio::client::outbound_limits limits;
+    limits.max_messages = 1;
+    limits.policy = policy;
+    client.set_outbound_limits(limits);
+    client.async_publish("bench/loopback/full", "payload", 1,
+                         mosquittoasio::client::publish_handler_type{});
+
+    auto connected = false;
+    auto connection = client.connected_signal.connect(
+        [&connected] { connected = true; });
+    client.connect("127.0.0.1", port, 60);
+    auto done = false;
+    try {
+        done = run_until(io, [&connected] { return connected; });
+    } catch (std::exception const& e) {
+        std::cerr << "check/connect_full_buffer/" << name << ": " << e.what()
+                  << '\n';
+    }
+    check(done, "connected_signal fired with a full outbound buffer, " + name);
+}
+
+void loopback_benchmarks(unsigned short port, std::string const& name,
+                         mosquittoasio::client::backend backend,
+                         bool pooled = false) {
+    auto prefix = "e2e/" + name;
+
+    boost::asio::io_service io;
+    mosquittoasio::client client{io, "mosquitto-asio-bench", true, backend};
+    if (pooled) {
+        client.enable_buffer_pool();
+    }
+    mosquittoasio::dispatcher dispatcher{client};
+
+    std::size_t received = 0;
+    auto subscription = dispatcher.subscribe(
+        "bench/loopback/#", 2,
+        [&received](mosquittoasio::message const&) { ++received; });
+
+    client.connect("127.0.0.1", port, 60);
+    // the subscription is in place once a probe comes back
+    auto ready = run_until(io, [&] {
+        if (client.is_connected() && !received) {
+            client.publish("bench/loopback/probe", "", 0);
+            io.run_one_for(std::chrono::milliseconds(1));
+        }
+        return received > 0;
+    });
+    if (!ready) {
+        std::cerr << prefix << ": could not connect, skipped\n";
+        return;
+    }
+
+    auto payload = std::string(64, 'x');
+
+    auto throughput = [&](int qos, std::size_t count) {
+        received = 0;
+        auto reads = read_syscalls();
+        auto allocs = allocations();
+        auto start = clock::now();
+        {
+            mosquittoasio::publish_batch batch{client};
+            for (std::size_t i = 0; i < count; ++i) {
+                client.publish("bench/loopback/throughput", payload, qos);
+            }
+        }
+        auto done = run_until(io, [&] { return received >= count; });
+        auto elapsed = clock::now() - start;
+        reads = read_syscalls() - reads;
+        allocs = allocations() - allocs;
+
+        auto test = prefix + "/qos" + std::to_string(qos) + "/throughput";
+        if (!done) {
+            std::cerr << test << ": " << received << " of " << count
+                      << " messages received, skipped\n";
+            return;
+        }
+        auto ns = std::chrono::duration<double, std::nano>(elapsed).count();
+        report({test, count, ns / count,
+                static_cast<double>(allocs) / count});
+        std::cout << "  read syscalls/msg: "
+                  << static_cast<double>(reads) / count << '\n';
+    };
+
+    throughput(0, 20000);
+    throughput(1, 5000);
+    throughput(2, 2000);
+
+    // round trips, one message in flight at a time
+    mosquittoasio::metrics::histogram rtt;
+    constexpr std::size_t round_trips = 2000;
+    auto allocs = allocations();
+    for (std::size_t i = 0; i < round_trips; ++i) {
+        received = 0;
+        auto start = clock::now();
+        client.publish("bench/loopback/rtt", payload, 0);
+        if (!run_until(io, [&] { return received > 0; })) {
+            std::cerr << prefix << "/rtt: timed out, skipped\n";
+            return;
+        }
+        rtt.record(mosquittoasio::metrics::elapsed_ns(start));
+    }
+    allocs = allocations() - allocs;
+
+    auto s = rtt.snapshot();
+    auto allocs_per_op = static_cast<double>(allocs) / round_trips;
+    report({prefix + "/qos0/rtt_p50", round_trips,
+            static_cast<double>(s.quantile(0.5)), allocs_per_op});
+    report({prefix + "/qos0/rtt_p99", round_trips,
+            static_cast<double>(s.quantile(0.99)), allocs_per_op});
+}
+
+}  // namespace
+
+void loopback_benchmarks(std::chrono::microseconds latency) {
+    // the broker runs on a thread of its own, as a real one would
+    boost::asio::io_service broker_io;
+    mosquittoasio::mqtt::loopback_broker::options options;
+    options.latency = latency;
+    mosquittoasio::mqtt::loopback_broker broker{broker_io, options};
+
+    boost::asio::io_service::work work{broker_io};
+    std::thread broker_thread{[&broker_io] { broker_io.run(); }};
+
+    using policy = mosquittoasio::client::overflow_policy;
+    check_connect_with_full_buffer(broker.port(), policy::fail, "fail");
+    check_connect_with_full_buffer(broker.port(), policy::block, "block");
+
+    using backend = mosquittoasio::client::backend;
+#if !MOSQUITTOASIO_STUB_MOSQUITTO
+    loopback_benchmarks(broker.port(), "native", backend::native);
+#endif
+    loopback_benchmarks(broker.port(), "asio", backend::asio);
+    loopback_benchmarks(broker.port(), "asio/pooled", backend::asio, true);
+
+    broker_io.stop();
+    broker_thread.join();
+}
+
+}  // namespace bench
@@ -0,0 +1,60 @@
+#include "bench.hpp"
+
+#include "mosquitto_asio/library.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+// usage: mosquitto-asio-bench [--broker host:port] [--json file]
+//                             [--loopback-latency microseconds]
+//                             [--fleet clients[,clients...]]
+int main(int argc, char** argv) {
+    mosquittoasio::library mosquitto_lib;
+
+    std::string broker;
+    std::string json;
+    long latency = 0;
+    std::vector<std::size_t> fleet;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::strcmp(argv[i], "--broker") == 0) {
+            broker = argv[++i];
+        } else if (std::strcmp(argv[i], "--json") == 0) {
+            json = argv[++i];
+        } else if (std::strcmp(argv[i], "--loopback-latency") == 0) {
+            latency = std::stol(argv[++i]);
+        } else if (std::strcmp(argv[i], "--fleet") == 0) {
+            std::istringstream sizes{argv[++i]};
+            std::string size;
+            while (std::getline(sizes, size, ',')) {
+                fleet.push_back(std::stoul(size));
+            }
+        }
+    }
+
+    bench::topic_tree_benchmarks();
+    bench::dispatcher_benchmarks();
+    bench::signal_benchmarks();
+    bench::message_benchmarks();
+    bench::timer_benchmarks();
+    bench::handler_benchmarks();
+    bench::offload_benchmarks();
+    bench::loopback_benchmarks(std::chrono::microseconds(latency));
+    bench::coroutine_benchmarks();
+    if (!fleet.empty()) {
+        bench::fleet_benchmarks(fleet);
+    }
+
+    auto colon = broker.rfind(':');
+    if (colon != std::string::npos) {
+        auto host = broker.substr(0, colon);
+        auto port = std::stoi(broker.substr(colon + 1));
+        bench::publish_benchmarks(host.c_str(), port);
+    }
+
+    if (!json.empty()) {
+        std::ofstream out{json};
+        bench::write_json(out);
+    }
+    return bench::checks_passed() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
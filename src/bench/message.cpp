@@ -0,0 +1,44 @@
+#include "bench.hpp"
+
+#include "mosquitto_asio/buffer_pool.hpp"
+#include "mosquitto_asio/message.hpp"
+
+#include <vector>
+
+namespace bench {
+namespace {
+
+// messages are built in batches and released together, as the client
+// delivers them
+void message_benchmark(std::string const& name, std::size_t payload_size,
+                       mosquittoasio::buffer_pool* pool) {
+    constexpr std::size_t batch = 32;
+    auto payload = std::string(payload_size, 'x');
+    std::vector<mosquittoasio::message> messages;
+    messages.reserve(batch);
+
+    auto r = run(name + "/" + std::to_string(payload_size), 20000,
+                 [&](std::size_t) {
+                     for (std::size_t i = 0; i < batch; ++i) {
+                         messages.emplace_back(
+                             "bench/message/topic", payload, 0, false, 0,
+                             mosquittoasio::invalid_topic_id, pool);
+                     }
+                     messages.clear();
+                 });
+    r.ns_per_op /= batch;
+    r.allocations_per_op /= batch;
+    report(r);
+}
+
+}  // namespace
+
+void message_benchmarks() {
+    mosquittoasio::buffer_pool pool;
+    for (std::size_t size : {64, 1024, 16384}) {
+        message_benchmark("message/heap", size, nullptr);
+        message_benchmark("message/pooled", size, &pool);
+    }
+}
+
+}  // namespace bench
@@ -0,0 +1,94 @@
+#include "bench.hpp"
+
+#include "mosquitto_asio/client.hpp"
+#include "mosquitto_asio/dispatcher.hpp"
+#include "mosquitto_asio/offload_executor.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace bench {
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+constexpr std::size_t topics = 64;
+constexpr std::size_t messages = 20000;
+
+// a handler doing 20 us of work, as a database write would block for
+void slow_handler(mosquittoasio::message const&) {
+    auto until = clock::now() + std::chrono::microseconds(20);
+    while (clock::now() < until) {
+    }
+}
+
+// the time the client strand spends on each message, and the time until
+// every message is handled
+void offload_benchmark(std::size_t threads) {
+    auto prefix = threads ? "offload/pool" + std::to_string(threads)
+                          : std::string{"offload/inline"};
+
+    boost::asio::io_service io;
+    mosquittoasio::client client{io};
+    mosquittoasio::dispatcher dispatcher{client};
+
+    boost::asio::io_service workers;
+    std::unique_ptr<boost::asio::io_service::work> work{
+        new boost::asio::io_service::work{workers}};
+    std::vector<std::thread> pool;
+    for (std::size_t i = 0; i < threads; ++i) {
+        pool.emplace_back([&workers] { workers.run(); });
+    }
+    mosquittoasio::offload_executor::options options;
+    options.max_queued = 4096;
+    mosquittoasio::offload_executor executor{workers, options};
+
+    std::atomic<std::size_t> handled{0};
+    auto handler = [&handled](mosquittoasio::message const& msg) {
+        slow_handler(msg);
+        ++handled;
+    };
+    auto s = threads ? dispatcher.subscribe("bench/offload/#", 0, handler,
+                                            executor)
+                     : dispatcher.subscribe("bench/offload/#", 0, handler);
+
+    std::vector<mosquittoasio::message> batch;
+    for (std::size_t i = 0; i < topics; ++i) {
+        batch.emplace_back("bench/offload/" + std::to_string(i), "payload", 0,
+                           false, 0);
+    }
+
+    auto allocs = allocations();
+    auto start = clock::now();
+    for (std::size_t i = 0; i < messages; ++i) {
+        client.message_received_signal(batch[i % topics]);
+    }
+    auto dispatched = clock::now();
+    allocs = allocations() - allocs;
+    while (handled < messages) {
+        std::this_thread::yield();
+    }
+    auto done = clock::now();
+
+    auto per_message = [](clock::duration d) {
+        return std::chrono::duration<double, std::nano>(d).count() / messages;
+    };
+    report({prefix + "/dispatch", messages, per_message(dispatched - start),
+            static_cast<double>(allocs) / messages});
+    report({prefix + "/complete", messages, per_message(done - start), 0});
+
+    work.reset();
+    for (auto& t : pool) {
+        t.join();
+    }
+}
+
+}  // namespace
+
+void offload_benchmarks() {
+    offload_benchmark(0);
+    offload_benchmark(4);
+}
+
+}  // namespace bench
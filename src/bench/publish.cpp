@@ -0,0 +1,85 @@
+#include "bench.hpp"
+
+#include "mosquitto_asio/client.hpp"
+
+namespace bench {
+namespace {
+
+void publish_benchmarks(char const* host, int port, std::string const& name,
+                        mosquittoasio::client::backend backend) {
+    boost::asio::io_service io;
+    mosquittoasio::client client{io, "mosquitto-asio-bench", true, backend};
+
+    auto connected = false;
+    mosquittoasio::scoped_connection connection =
+        client.connected_signal.connect([&connected] { connected = true; });
+
+    // the client logs every packet, keep it out of the output
+    auto buffer = std::cout.rdbuf(nullptr);
+
+    client.connect(host, port, 60);
+    while (!connected) {
+        io.run_one();
+    }
+
+    constexpr std::size_t count = 20000;
+    auto payload = std::string(64, 'x');
+
+    auto measure = [&](std::string test, bool corked) {
+        using clock = std::chrono::steady_clock;
+
+        // the packets are written in order, once the last one completes
+        // every one before it is written as well
+        auto written = false;
+        auto on_written = [&written](std::error_code, int) { written = true; };
+
+        auto writes = write_syscalls();
+        auto allocs = allocations();
+        auto start = clock::now();
+        if (corked) {
+            mosquittoasio::publish_batch batch{client};
+            for (std::size_t i = 1; i < count; ++i) {
+                client.publish("bench/publish", payload, 0);
+            }
+            client.async_publish("bench/publish", payload, 0, on_written);
+        } else {
+            for (std::size_t i = 1; i < count; ++i) {
+                client.publish("bench/publish", payload, 0);
+            }
+            client.async_publish("bench/publish", payload, 0, on_written);
+        }
+        while (!written) {
+            io.run_one();
+        }
+        auto elapsed = clock::now() - start;
+        writes = write_syscalls() - writes;
+        allocs = allocations() - allocs;
+
+        auto ns = std::chrono::duration<double, std::nano>(elapsed).count();
+
+        std::cout.rdbuf(buffer);
+        report({"publish/" + name + "/qos0/" + test, count, ns / count,
+                static_cast<double>(allocs) / count});
+        std::cout << "  write syscalls/msg: "
+                  << static_cast<double>(writes) / count << '\n';
+        std::cout.rdbuf(nullptr);
+    };
+
+    measure("single", false);
+    measure("batch", true);
+
+    std::cout.rdbuf(buffer);
+    std::cout.clear();
+}
+
+}  // namespace
+
+void publish_benchmarks(char const* host, int port) {
+    using backend = mosquittoasio::client::backend;
+#if !MOSQUITTOASIO_STUB_MOSQUITTO
+    publish_benchmarks(host, port, "native", backend::native);
+#endif
+    publish_benchmarks(host, port, "asio", backend::asio);
+}
+
+}  // namespace bench
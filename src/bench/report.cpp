@@ -0,0 +1,75 @@
+#include "bench.hpp"
+
+namespace bench {
+namespace {
+
+std::vector<result>& results() {
+    static std::vector<result> r;
+    return r;
+}
+
+void write_escaped(std::ostream& out, std::string const& s) {
+    out << '"';
+    for (auto c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\';
+        }
+        out << c;
+    }
+    out << '"';
+}
+
+bool& failed_checks() {
+    static bool failed = false;
+    return failed;
+}
+
+}  // namespace
+
+void check(bool passed, std::string const& what) {
+    if (!passed) {
+        failed_checks() = true;
+        std::cerr << "check failed: " << what << '\n';
+    }
+}
+
+bool checks_passed() {
+    return !failed_checks();
+}
+
+void report(result const& r) {
+    results().push_back(r);
+    std::cout << std::left << std::setw(48) << r.name
+              << std::right << std::setw(12) << std::fixed
+              << std::setprecision(1) << r.ns_per_op << " ns/op"
+              << std::setw(14) << static_cast<long long>(1e9 / r.ns_per_op)
+              << " op/s" << std::setw(10) << std::setprecision(2)
+              << r.allocations_per_op << " alloc/op";
+    if (r.bytes_per_op) {
+        std::cout << std::setw(12) << std::setprecision(0) << r.bytes_per_op
+                  << " B/op";
+    }
+    std::cout << '\n';
+}
+
+void write_json(std::ostream& out) {
+    // one result per line, fields in a fixed order and fixed precision so
+    // runs can be diffed
+    out << "{\n  \"version\": 1,\n  \"results\": [";
+    auto first = true;
+    for (auto const& r : results()) {
+        out << (first ? "\n" : ",\n") << "    {\"name\": ";
+        write_escaped(out, r.name);
+        out << ", \"iterations\": " << r.iterations << std::fixed
+            << std::setprecision(1) << ", \"ns_per_op\": " << r.ns_per_op
+            << ", \"ops_per_sec\": " << 1e9 / r.ns_per_op
+            << std::setprecision(3)
+            << ", \"allocations_per_op\": " << r.allocations_per_op
+            << std::setprecision(0) << ", \"bytes_per_op\": " << r.bytes_per_op
+            << '}';
+        first = false;
+    }
+    out << "\n  ]\n}\n";
+}
+
+}  // namespace bench
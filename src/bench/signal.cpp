@@ -0,0 +1,86 @@
+#include "bench.hpp"
+
+#include "mosquitto_asio/client.hpp"
+#include "mosquitto_asio/dispatcher.hpp"
+#include "mosquitto_asio/signal.hpp"
+
+#include <vector>
+
+namespace bench {
+namespace {
+
+mosquittoasio::message make_message(char const* topic) {
+    char payload[] = "payload";
+    mosquittoasio::native::message_type native{};
+    native.topic = const_cast<char*>(topic);
+    native.payload = payload;
+    native.payloadlen = sizeof(payload) - 1;
+    return mosquittoasio::message{native};
+}
+
+template <typename Signal, typename Connection>
+void emit_benchmark(std::string const& name, std::size_t slots) {
+    auto msg = make_message("bench/signal");
+    std::size_t calls = 0;
+
+    Signal signal;
+    std::vector<Connection> connections;
+    for (std::size_t i = 0; i < slots; ++i) {
+        connections.push_back(signal.connect(
+            [&calls](mosquittoasio::message const&) { ++calls; }));
+    }
+
+    report(run(name + "/" + std::to_string(slots), 1000000,
+               [&](std::size_t) { signal(msg); }));
+    do_not_optimize(calls);
+
+    report(run(name + "/connect_disconnect", 200000, [&](std::size_t) {
+        signal.connect([](mosquittoasio::message const&) {}).disconnect();
+    }));
+}
+
+}  // namespace
+
+void signal_benchmarks() {
+    using callback_type = void(mosquittoasio::message const&);
+
+    for (std::size_t slots : {1, 4}) {
+        emit_benchmark<boost::signals2::signal<callback_type>,
+                       boost::signals2::scoped_connection>(
+            "emit/signals2", slots);
+        emit_benchmark<mosquittoasio::lightweight::signal<callback_type>,
+                       mosquittoasio::lightweight::scoped_connection>(
+            "emit/lightweight", slots);
+    }
+
+    // the full dispatch path, from the client signal to the subscribers,
+    // with the signal implementation selected at compile time
+    boost::asio::io_service io;
+    mosquittoasio::client client{io};
+    mosquittoasio::dispatcher dispatcher{client};
+
+    std::size_t calls = 0;
+    auto handler = [&calls](mosquittoasio::message const&) { ++calls; };
+    auto sub1 = dispatcher.subscribe("bench/dispatch/+", 0, handler);
+    auto sub2 = dispatcher.subscribe("bench/dispatch/#", 0, handler);
+    auto sub3 = dispatcher.subscribe("bench/dispatch/topic", 0, handler);
+
+    auto msg = make_message("bench/dispatch/topic");
+
+    // the dispatcher logs every message, keep it out of the output
+    auto buffer = std::cout.rdbuf(nullptr);
+    auto r = run(
+#if MOSQUITTOASIO_LIGHTWEIGHT_SIGNALS
+        "dispatch/lightweight",
+#else
+        "dispatch/signals2",
+#endif
+        200000, [&](std::size_t) { client.message_received_signal(msg); });
+    std::cout.rdbuf(buffer);
+    std::cout.clear();
+
+    report(r);
+    do_not_optimize(calls);
+}
+
+}  // namespace bench
@@ -0,0 +1,207 @@
+#include "mosquitto.h"
+
+#include <cstring>
+#include <new>
+
+// A libmosquitto without networking: handles are created and configured,
+// every connection attempt fails with MOSQ_ERR_NOT_SUPPORTED and topics
+// are matched like libmosquitto does. It lets the asio backend, which only
+// matches topics through libmosquitto, and the construction of native
+// clients be measured where libmosquitto is not installed.
+
+struct mosquitto {
+    void* obj;
+};
+
+extern "C" {
+
+int mosquitto_lib_init(void) {
+    return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_lib_cleanup(void) {
+    return MOSQ_ERR_SUCCESS;
+}
+
+struct mosquitto* mosquitto_new(const char*, bool, void* obj) {
+    return new (std::nothrow) mosquitto{obj};
+}
+
+void mosquitto_destroy(struct mosquitto* mosq) {
+    delete mosq;
+}
+
+void mosquitto_user_data_set(struct mosquitto* mosq, void* obj) {
+    mosq->obj = obj;
+}
+
+int mosquitto_threaded_set(struct mosquitto*, bool) {
+    return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_max_inflight_messages_set(struct mosquitto*, unsigned int) {
+    return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_tls_set(struct mosquitto*, const char*, const char*,
+                      const char*, const char*,
+                      int (*)(char*, int, int, void*)) {
+    return MOSQ_ERR_NOT_SUPPORTED;
+}
+
+int mosquitto_tls_opts_set(struct mosquitto*, int, const char*, const char*) {
+    return MOSQ_ERR_NOT_SUPPORTED;
+}
+
+void mosquitto_connect_callback_set(struct mosquitto*,
+                                    void (*)(struct mosquitto*, void*, int)) {
+}
+
+void mosquitto_disconnect_callback_set(
+    struct mosquitto*, void (*)(struct mosquitto*, void*, int)) {
+}
+
+void mosquitto_publish_callback_set(struct mosquitto*,
+                                    void (*)(struct mosquitto*, void*, int)) {
+}
+
+void mosquitto_message_callback_set(
+    struct mosquitto*,
+    void (*)(struct mosquitto*, void*, const struct mosquitto_message*)) {
+}
+
+void mosquitto_subscribe_callback_set(
+    struct mosquitto*, void (*)(struct mosquitto*, void*, int, int, const int*)) {
+}
+
+void mosquitto_unsubscribe_callback_set(
+    struct mosquitto*, void (*)(struct mosquitto*, void*, int)) {
+}
+
+void mosquitto_log_callback_set(
+    struct mosquitto*, void (*)(struct mosquitto*, void*, int, const char*)) {
+}
+
+int mosquitto_connect(struct mosquitto*, const char*, int, int) {
+    return MOSQ_ERR_NOT_SUPPORTED;
+}
+
+int mosquitto_connect_async(struct mosquitto*, const char*, int, int) {
+    return MOSQ_ERR_NOT_SUPPORTED;
+}
+
+int mosquitto_reconnect(struct mosquitto*) {
+    return MOSQ_ERR_NOT_SUPPORTED;
+}
+
+int mosquitto_reconnect_async(struct mosquitto*) {
+    return MOSQ_ERR_NOT_SUPPORTED;
+}
+
+int mosquitto_disconnect(struct mosquitto*) {
+    return MOSQ_ERR_NO_CONN;
+}
+
+int mosquitto_publish(struct mosquitto*, int*, const char*, int, const void*,
+                      int, bool) {
+    return MOSQ_ERR_NO_CONN;
+}
+
+int mosquitto_subscribe(struct mosquitto*, int*, const char*, int) {
+    return MOSQ_ERR_NO_CONN;
+}
+
+int mosquitto_unsubscribe(struct mosquitto*, int*, const char*) {
+    return MOSQ_ERR_NO_CONN;
+}
+
+int mosquitto_loop(struct mosquitto*, int, int) {
+    return MOSQ_ERR_NO_CONN;
+}
+
+int mosquitto_loop_read(struct mosquitto*, int) {
+    return MOSQ_ERR_NO_CONN;
+}
+
+int mosquitto_loop_write(struct mosquitto*, int) {
+    return MOSQ_ERR_NO_CONN;
+}
+
+int mosquitto_loop_misc(struct mosquitto*) {
+    return MOSQ_ERR_NO_CONN;
+}
+
+int mosquitto_socket(struct mosquitto*) {
+    return -1;
+}
+
+bool mosquitto_want_write(struct mosquitto*) {
+    return false;
+}
+
+const char* mosquitto_strerror(int mosq_errno) {
+    switch (mosq_errno) {
+        case MOSQ_ERR_SUCCESS:
+            return "No error.";
+        case MOSQ_ERR_NO_CONN:
+            return "The client is not currently connected.";
+        case MOSQ_ERR_NOT_SUPPORTED:
+            return "This feature is not supported.";
+        case MOSQ_ERR_INVAL:
+            return "Invalid function arguments provided.";
+        default:
+            return "Unknown error.";
+    }
+}
+
+int mosquitto_topic_matches_sub(const char* sub, const char* topic,
+                                bool* result) {
+    if (!sub || !topic || !result || !*sub || !*topic) {
+        return MOSQ_ERR_INVAL;
+    }
+    *result = false;
+    // wildcards do not match the $ topics
+    if ((*sub == '+' || *sub == '#') && *topic == '$') {
+        return MOSQ_ERR_SUCCESS;
+    }
+    while (*sub) {
+        if (*sub == '#') {
+            *result = sub[1] == '\0';
+            return *result ? MOSQ_ERR_SUCCESS : MOSQ_ERR_INVAL;
+        }
+        if (*sub == '+') {
+            // the whole level of the topic
+            while (*topic && *topic != '/') {
+                ++topic;
+            }
+            ++sub;
+        } else {
+            auto level = std::strcspn(sub, "/");
+            if (std::strncmp(sub, topic, level) ||
+                (topic[level] && topic[level] != '/')) {
+                return MOSQ_ERR_SUCCESS;
+            }
+            sub += level;
+            topic += level;
+        }
+        if (!*sub) {
+            *result = !*topic;
+            return MOSQ_ERR_SUCCESS;
+        }
+        if (!*topic) {
+            // "a/#" matches "a" as well
+            *result = std::strcmp(sub, "/#") == 0;
+            return MOSQ_ERR_SUCCESS;
+        }
+        // both are on a separator
+        if (*sub != '/' || *topic != '/') {
+            return MOSQ_ERR_SUCCESS;
+        }
+        ++sub;
+        ++topic;
+    }
+    *result = !*topic;
+    return MOSQ_ERR_SUCCESS;
+}
+
+}  // extern "C"
@@ -0,0 +1,117 @@
+#pragma once
+
+// The subset of the libmosquitto API used by the library, declared for the
+// stub built with -DMOSQUITTOASIO_STUB_MOSQUITTO=ON; the values match
+// libmosquitto 1.6
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct mosquitto;
+
+struct mosquitto_message {
+    int mid;
+    char* topic;
+    void* payload;
+    int payloadlen;
+    int qos;
+    bool retain;
+};
+
+enum mosq_err_t {
+    MOSQ_ERR_CONN_PENDING = -1,
+    MOSQ_ERR_SUCCESS = 0,
+    MOSQ_ERR_NOMEM = 1,
+    MOSQ_ERR_PROTOCOL = 2,
+    MOSQ_ERR_INVAL = 3,
+    MOSQ_ERR_NO_CONN = 4,
+    MOSQ_ERR_CONN_REFUSED = 5,
+    MOSQ_ERR_NOT_FOUND = 6,
+    MOSQ_ERR_CONN_LOST = 7,
+    MOSQ_ERR_TLS = 8,
+    MOSQ_ERR_PAYLOAD_SIZE = 9,
+    MOSQ_ERR_NOT_SUPPORTED = 10,
+    MOSQ_ERR_AUTH = 11,
+    MOSQ_ERR_ACL_DENIED = 12,
+    MOSQ_ERR_UNKNOWN = 13,
+    MOSQ_ERR_ERRNO = 14,
+    MOSQ_ERR_EAI = 15,
+    MOSQ_ERR_PROXY = 16
+};
+
+#define MOSQ_LOG_INFO 0x01
+#define MOSQ_LOG_NOTICE 0x02
+#define MOSQ_LOG_WARNING 0x04
+#define MOSQ_LOG_ERR 0x08
+#define MOSQ_LOG_DEBUG 0x10
+
+int mosquitto_lib_init(void);
+int mosquitto_lib_cleanup(void);
+
+struct mosquitto* mosquitto_new(const char* id, bool clean_session, void* obj);
+void mosquitto_destroy(struct mosquitto* mosq);
+void mosquitto_user_data_set(struct mosquitto* mosq, void* obj);
+int mosquitto_threaded_set(struct mosquitto* mosq, bool threaded);
+int mosquitto_max_inflight_messages_set(struct mosquitto* mosq,
+                                        unsigned int max_inflight_messages);
+int mosquitto_tls_set(struct mosquitto* mosq, const char* cafile,
+                      const char* capath, const char* certfile,
+                      const char* keyfile,
+                      int (*pw_callback)(char* buf, int size, int rwflag,
+                                         void* userdata));
+int mosquitto_tls_opts_set(struct mosquitto* mosq, int cert_reqs,
+                           const char* tls_version, const char* ciphers);
+
+void mosquitto_connect_callback_set(
+    struct mosquitto* mosq, void (*on_connect)(struct mosquitto*, void*, int));
+void mosquitto_disconnect_callback_set(
+    struct mosquitto* mosq,
+    void (*on_disconnect)(struct mosquitto*, void*, int));
+void mosquitto_publish_callback_set(
+    struct mosquitto* mosq, void (*on_publish)(struct mosquitto*, void*, int));
+void mosquitto_message_callback_set(
+    struct mosquitto* mosq,
+    void (*on_message)(struct mosquitto*, void*,
+                       const struct mosquitto_message*));
+void mosquitto_subscribe_callback_set(
+    struct mosquitto* mosq,
+    void (*on_subscribe)(struct mosquitto*, void*, int, int, const int*));
+void mosquitto_unsubscribe_callback_set(
+    struct mosquitto* mosq,
+    void (*on_unsubscribe)(struct mosquitto*, void*, int));
+void mosquitto_log_callback_set(
+    struct mosquitto* mosq,
+    void (*on_log)(struct mosquitto*, void*, int, const char*));
+
+int mosquitto_connect(struct mosquitto* mosq, const char* host, int port,
+                      int keepalive);
+int mosquitto_connect_async(struct mosquitto* mosq, const char* host,
+                            int port, int keepalive);
+int mosquitto_reconnect(struct mosquitto* mosq);
+int mosquitto_reconnect_async(struct mosquitto* mosq);
+int mosquitto_disconnect(struct mosquitto* mosq);
+
+int mosquitto_publish(struct mosquitto* mosq, int* mid, const char* topic,
+                      int payloadlen, const void* payload, int qos,
+                      bool retain);
+int mosquitto_subscribe(struct mosquitto* mosq, int* mid, const char* sub,
+                        int qos);
+int mosquitto_unsubscribe(struct mosquitto* mosq, int* mid, const char* sub);
+
+int mosquitto_loop(struct mosquitto* mosq, int timeout, int max_packets);
+int mosquitto_loop_read(struct mosquitto* mosq, int max_packets);
+int mosquitto_loop_write(struct mosquitto* mosq, int max_packets);
+int mosquitto_loop_misc(struct mosquitto* mosq);
+int mosquitto_socket(struct mosquitto* mosq);
+bool mosquitto_want_write(struct mosquitto* mosq);
+
+const char* mosquitto_strerror(int mosq_errno);
+int mosquitto_topic_matches_sub(const char* sub, const char* topic,
+                                bool* result);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,88 @@
+#include "bench.hpp"
+
+#include <dlfcn.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <atomic>
+
+// Interposes the libc read and write families, the definitions in the
+// executable take precedence over libc for libmosquitto as well, so every
+// read and write syscall issued by either backend is counted. Reads are
+// counted per thread, leaving out those of a broker running in the process.
+
+namespace {
+
+std::atomic<long long> g_write_calls{0};
+thread_local long long t_read_calls = 0;
+
+template <typename Function>
+Function next_symbol(char const* name) {
+    return reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+}
+
+}  // namespace
+
+extern "C" {
+
+ssize_t write(int fd, void const* buf, size_t count) {
+    static auto next = next_symbol<decltype(&write)>("write");
+    ++g_write_calls;
+    return next(fd, buf, count);
+}
+
+ssize_t writev(int fd, iovec const* iov, int iovcnt) {
+    static auto next = next_symbol<decltype(&writev)>("writev");
+    ++g_write_calls;
+    return next(fd, iov, iovcnt);
+}
+
+ssize_t send(int fd, void const* buf, size_t len, int flags) {
+    static auto next = next_symbol<decltype(&send)>("send");
+    ++g_write_calls;
+    return next(fd, buf, len, flags);
+}
+
+ssize_t sendmsg(int fd, msghdr const* msg, int flags) {
+    static auto next = next_symbol<decltype(&sendmsg)>("sendmsg");
+    ++g_write_calls;
+    return next(fd, msg, flags);
+}
+
+ssize_t read(int fd, void* buf, size_t count) {
+    static auto next = next_symbol<decltype(&read)>("read");
+    ++t_read_calls;
+    return next(fd, buf, count);
+}
+
+ssize_t readv(int fd, iovec const* iov, int iovcnt) {
+    static auto next = next_symbol<decltype(&readv)>("readv");
+    ++t_read_calls;
+    return next(fd, iov, iovcnt);
+}
+
+ssize_t recv(int fd, void* buf, size_t len, int flags) {
+    static auto next = next_symbol<decltype(&recv)>("recv");
+    ++t_read_calls;
+    return next(fd, buf, len, flags);
+}
+
+ssize_t recvmsg(int fd, msghdr* msg, int flags) {
+    static auto next = next_symbol<decltype(&recvmsg)>("recvmsg");
+    ++t_read_calls;
+    return next(fd, msg, flags);
+}
+}
+
+namespace bench {
+
+long long write_syscalls() {
+    return g_write_calls;
+}
+
+long long read_syscalls() {
+    return t_read_calls;
+}
+
+}  // namespace bench
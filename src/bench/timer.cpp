@@ -0,0 +1,142 @@
+#include "bench.hpp"
+
+#include "mosquitto_asio/handler_allocator.hpp"
+#include "mosquitto_asio/timer_wheel.hpp"
+
+#include <boost/asio.hpp>
+
+#include <functional>
+#include <memory>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+namespace bench {
+namespace {
+
+using error_code = boost::system::error_code;
+
+struct default_storage {
+    template <typename Handler>
+    Handler operator()(Handler h) const {
+        return h;
+    }
+};
+
+struct recycled_storage {
+    std::shared_ptr<mosquittoasio::handler_allocator> allocator;
+
+    template <typename Handler>
+    mosquittoasio::allocating_handler<Handler> operator()(Handler h) const {
+        return mosquittoasio::make_allocating_handler(allocator,
+                                                      std::move(h));
+    }
+};
+
+// re-arms one of many timers at a time, as every client does on each keep
+// alive deadline; the aborted waits are run along. Returns the heap
+// allocations per re-arm
+template <typename Timer, typename Bind>
+double rearm_benchmark(std::string const& name, std::size_t timers,
+                       Bind bind) {
+    boost::asio::io_service io;
+    std::vector<std::unique_ptr<Timer>> pool;
+    std::size_t calls = 0;
+    auto handler = bind([&calls](error_code) { ++calls; });
+    for (std::size_t i = 0; i < timers; ++i) {
+        pool.emplace_back(new Timer{io});
+        pool.back()->expires_from_now(std::chrono::seconds(60 + i % 60));
+        pool.back()->async_wait(handler);
+    }
+    io.poll();
+
+    auto r = run(name + "/" + std::to_string(timers), 200000,
+                 [&](std::size_t i) {
+                     auto& t = *pool[i % timers];
+                     t.expires_from_now(std::chrono::seconds(60 + i % 60));
+                     t.async_wait(handler);
+                     if (i % 8 == 0) {
+                         io.poll();
+                     }
+                 });
+    report(r);
+    do_not_optimize(calls);
+    return r.allocations_per_op;
+}
+
+// timers standing for idle clients, each one re-armed by its handler every
+// second, the deadlines spread over the second: the cpu time of each timer
+// and second, and the wheel wake ups per second
+template <typename Timer, typename Bind>
+void idle_benchmark(std::string const& name, std::size_t timers, Bind bind) {
+    constexpr auto seconds = 2;
+    using clock = std::chrono::steady_clock;
+
+    boost::asio::io_service io;
+    std::vector<std::unique_ptr<Timer>> pool;
+    std::size_t expired = 0;
+    std::function<void(Timer&)> arm = [&](Timer& t) {
+        t.expires_at(t.expiry() + std::chrono::seconds(1));
+        t.async_wait(bind([&arm, &t, &expired](error_code ec) {
+            if (!ec) {
+                ++expired;
+                arm(t);
+            }
+        }));
+    };
+    std::mt19937 random{42};
+    std::uniform_int_distribution<int> spread{0, 999};
+    auto start = clock::now();
+    for (std::size_t i = 0; i < timers; ++i) {
+        pool.emplace_back(new Timer{io});
+        pool.back()->expires_at(start - std::chrono::seconds(1) +
+                                std::chrono::milliseconds(spread(random)));
+        arm(*pool.back());
+    }
+
+    auto& wheel = boost::asio::use_service<mosquittoasio::timer_wheel>(io);
+    auto wakeups = wheel.wakeups();
+    auto allocs = allocations();
+    auto cpu = cpu_ns();
+    io.run_for(std::chrono::seconds(seconds));
+    cpu = cpu_ns() - cpu;
+    allocs = allocations() - allocs;
+    wakeups = wheel.wakeups() - wakeups;
+
+    auto n = static_cast<double>(timers);
+    report({name + "/" + std::to_string(timers), timers * seconds,
+            cpu / n / seconds,
+            expired ? static_cast<double>(allocs) / expired : 0});
+    std::cout << "  expirations/s: " << expired / seconds;
+    if (std::is_same<Timer, mosquittoasio::wheel_timer>::value) {
+        std::cout << ", wheel wake ups/s: " << wakeups / seconds;
+    }
+    std::cout << '\n';
+}
+
+}  // namespace
+
+void timer_benchmarks() {
+    auto recycled = recycled_storage{
+        std::make_shared<mosquittoasio::handler_allocator>()};
+    for (std::size_t timers : {1000, 50000}) {
+        rearm_benchmark<boost::asio::steady_timer>("timer/steady_timer/rearm",
+                                                    timers, default_storage{});
+        rearm_benchmark<mosquittoasio::wheel_timer>(
+            "timer/wheel_timer/rearm", timers, default_storage{});
+        rearm_benchmark<boost::asio::steady_timer>(
+            "timer/steady_timer/rearm_recycled", timers, recycled);
+        auto allocs = rearm_benchmark<mosquittoasio::wheel_timer>(
+            "timer/wheel_timer/rearm_recycled", timers, recycled);
+        check(allocs == 0,
+              "wheel_timer waits with recycled storage allocated nothing");
+    }
+    for (std::size_t timers : {1000, 10000}) {
+        idle_benchmark<boost::asio::steady_timer>("timer/steady_timer/idle",
+                                                   timers, recycled);
+        idle_benchmark<mosquittoasio::wheel_timer>("timer/wheel_timer/idle",
+                                                    timers, recycled);
+    }
+}
+
+}  // namespace bench
@@ -0,0 +1,61 @@
+#include "bench.hpp"
+
+#include <random>
+#include <unordered_set>
+
+namespace bench {
+
+wildcard_mix const exact_mix{"exact", 0, 0};
+wildcard_mix const mixed_mix{"mixed", 15, 5};
+wildcard_mix const wild_mix{"wild", 40, 25};
+
+topic_set make_topic_set(std::size_t filter_count, std::size_t topic_count,
+                         wildcard_mix mix) {
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<int> depth_dist{2, 6};
+    std::uniform_int_distribution<int> level_dist{0, 31};
+    std::uniform_int_distribution<int> wildcard_dist{0, 99};
+
+    auto make_level = [&](int depth) {
+        return "l" + std::to_string(depth) + "_" +
+               std::to_string(level_dist(rng));
+    };
+
+    topic_set set;
+    std::unordered_set<std::string> unique;
+    while (set.filters.size() < filter_count) {
+        auto depth = depth_dist(rng);
+        std::string filter;
+        for (int d = 0; d < depth; ++d) {
+            if (d) {
+                filter += '/';
+            }
+            auto w = wildcard_dist(rng);
+            if (d == depth - 1 && w < mix.hash_percent) {
+                filter += '#';
+            } else if (d && w < mix.plus_percent) {
+                filter += '+';
+            } else {
+                filter += make_level(d);
+            }
+        }
+        if (unique.insert(filter).second) {
+            set.filters.push_back(std::move(filter));
+        }
+    }
+
+    while (set.topics.size() < topic_count) {
+        auto depth = depth_dist(rng);
+        std::string topic;
+        for (int d = 0; d < depth; ++d) {
+            if (d) {
+                topic += '/';
+            }
+            topic += make_level(d);
+        }
+        set.topics.push_back(std::move(topic));
+    }
+    return set;
+}
+
+}  // namespace bench
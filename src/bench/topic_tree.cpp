@@ -0,0 +1,145 @@
+#include "bench.hpp"
+
+#include "mosquitto_asio/match_cache.hpp"
+#include "mosquitto_asio/native.hpp"
+#include "mosquitto_asio/topic_tree.hpp"
+
+#include <vector>
+
+namespace bench {
+namespace {
+
+using mosquittoasio::native::topic_matches_subscription;
+using tree_type = mosquittoasio::topic_tree<std::string const*>;
+
+constexpr std::size_t topic_count = 1024;
+
+void match_benchmarks(std::size_t count, wildcard_mix mix) {
+    auto set = make_topic_set(count, topic_count, mix);
+    auto suffix = std::string{"/"} + mix.name + "/" + std::to_string(count);
+
+    tree_type tree;
+    for (auto const& filter : set.filters) {
+        tree.insert(filter, &filter);
+    }
+
+    std::size_t scan_matches = 0;
+    report(run("match/scan" + suffix, 200000 / count + 100,
+               [&](std::size_t i) {
+                   auto const& topic = set.topics[i % topic_count];
+                   for (auto const& filter : set.filters) {
+                       if (topic_matches_subscription(filter.c_str(),
+                                                      topic.c_str())) {
+                           ++scan_matches;
+                       }
+                   }
+               }));
+
+    std::size_t tree_matches = 0;
+    report(run("match/topic_tree" + suffix, 200000, [&](std::size_t i) {
+        tree.match(set.topics[i % topic_count],
+                   [&](std::string const*) { ++tree_matches; });
+    }));
+
+    // repeated topics, every one of them fits in the cache
+    mosquittoasio::match_cache<std::string const*> cache{topic_count};
+    std::vector<std::string const*> matched;
+    std::size_t cache_matches = 0;
+    report(run("match/match_cache" + suffix, 200000, [&](std::size_t i) {
+        auto const& topic = set.topics[i % topic_count];
+        auto cached = cache.find(topic);
+        if (!cached) {
+            matched.clear();
+            tree.match(topic, [&](std::string const* filter) {
+                matched.push_back(filter);
+            });
+            cache.insert(topic, matched);
+            cached = &matched;
+        }
+        cache_matches += cached->size();
+    }));
+    if (cache_matches != tree_matches) {
+        std::cerr << "match_cache mismatch" << suffix << " tree:"
+                  << tree_matches << " cache:" << cache_matches << '\n';
+    }
+
+    // the same topics interned, their index being their id
+    mosquittoasio::match_cache<std::string const*> id_cache{topic_count};
+    std::size_t id_matches = 0;
+    report(run("match/match_cache_by_id" + suffix, 200000, [&](std::size_t i) {
+        auto id = static_cast<mosquittoasio::topic_id>(i % topic_count);
+        auto const& topic = set.topics[id];
+        auto cached = id_cache.find(topic, id);
+        if (!cached) {
+            matched.clear();
+            tree.match(topic, [&](std::string const* filter) {
+                matched.push_back(filter);
+            });
+            id_cache.insert(topic, matched, id);
+            cached = &matched;
+        }
+        id_matches += cached->size();
+    }));
+    if (id_matches != tree_matches) {
+        std::cerr << "match_cache_by_id mismatch" << suffix << " tree:"
+                  << tree_matches << " cache:" << id_matches << '\n';
+    }
+
+    // both should agree on the matches of the first topics
+    std::size_t scan_pass = 0;
+    std::size_t tree_pass = 0;
+    for (std::size_t i = 0; i < 64; ++i) {
+        auto const& topic = set.topics[i];
+        for (auto const& filter : set.filters) {
+            scan_pass +=
+                topic_matches_subscription(filter.c_str(), topic.c_str());
+        }
+        tree.match(topic, [&](std::string const*) { ++tree_pass; });
+    }
+    if (scan_pass != tree_pass) {
+        std::cerr << "topic_tree mismatch" << suffix << " scan:" << scan_pass
+                  << " tree:" << tree_pass << '\n';
+    }
+    do_not_optimize(scan_matches);
+    do_not_optimize(tree_matches);
+    do_not_optimize(cache_matches);
+    do_not_optimize(id_matches);
+
+    std::size_t churn = 0;
+    report(run("insert_erase/topic_tree" + suffix, 100000,
+               [&](std::size_t i) {
+                   auto const& filter = set.filters[i % count];
+                   churn += tree.erase(filter);
+                   churn += tree.insert(filter, &filter);
+               }));
+    do_not_optimize(churn);
+}
+
+// a single filter against a single topic
+void native_benchmarks(wildcard_mix mix) {
+    auto set = make_topic_set(1000, topic_count, mix);
+    std::size_t matches = 0;
+    report(run(std::string{"native/topic_matches_subscription/"} + mix.name,
+               1000000, [&](std::size_t i) {
+                   matches += topic_matches_subscription(
+                       set.filters[i % 1000].c_str(),
+                       set.topics[i % topic_count].c_str());
+               }));
+    do_not_optimize(matches);
+}
+
+}  // namespace
+
+void topic_tree_benchmarks() {
+    for (std::size_t count : {10, 100, 1000, 10000, 100000}) {
+        match_benchmarks(count, mixed_mix);
+    }
+    match_benchmarks(10000, exact_mix);
+    match_benchmarks(10000, wild_mix);
+
+    for (auto const& mix : {exact_mix, mixed_mix, wild_mix}) {
+        native_benchmarks(mix);
+    }
+}
+
+}  // namespace bench
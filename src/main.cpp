@@ -48,11 +48,11 @@ int main() {
 
     *sub4 = disp.subscribe(
         "mosquitto-asio/unsub", 0,
-        [&](std::string const& topic, std::string const& payload) {
+        [&](mosquittoasio::message const& msg) {
             std::cout << "got mosquitto message!\n"
                       << " subscribed to:\"mosquitto-asio/unsub"
-                      << "\"\n topic:\"" << topic
-                      << "\"\n payload:\"" << payload
+                      << "\"\n topic:\"" << msg.topic()
+                      << "\"\n payload:\"" << msg.payload()
                       << "\"\n"
                       << " unsubscribing!\n";
 
@@ -68,11 +68,11 @@ int main() {
     auto make_sub = [&disp](std::string sub_topic) {
         return disp.subscribe(
             sub_topic, 0,
-            [sub_topic](std::string const& topic, std::string const& payload) {
+            [sub_topic](mosquittoasio::message const& msg) {
                 std::cout << "got mosquitto message!\n"
                           << " subscribed to:\"" << sub_topic
-                          << "\"\n topic:\"" << topic
-                          << "\"\n payload:\"" << payload
+                          << "\"\n topic:\"" << msg.topic()
+                          << "\"\n payload:\"" << msg.payload()
                           << "\"\n";
             });
     };
@@ -83,14 +83,18 @@ int main() {
 
     *sub5 = disp.subscribe(
         "mosquitto-asio/test", 2,
-        [&](std::string const& topic, std::string const& payload) {
+        [&](mosquittoasio::message const& msg) {
             std::cout << "got mosquitto message! (2)\n"
                       << " subscribed to:\"mosquitto-asio/test"
-                      << "\"\n topic:\"" << topic
-                      << "\"\n payload:\"" << payload
+                      << "\"\n topic:\"" << msg.topic()
+                      << "\"\n payload:\"" << msg.payload()
                       << "\"\n";
         });
 
+    auto announce = mosquitto.connected_signal.connect([&mosquitto] {
+        mosquitto.publish("mosquitto-asio-test", "connected!", 0, false);
+    });
+
     mosquitto.connect(broker.host, broker.port, broker.keep_alive);
 
     io.run();
@@ -0,0 +1,147 @@
+#include "buffer_pool.hpp"
+
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace mosquittoasio {
+namespace {
+
+// index of the smallest class holding size bytes
+std::size_t size_class(std::size_t size) {
+    std::size_t index = 0;
+    while ((buffer_pool::min_capacity << index) < size) {
+        ++index;
+    }
+    return index;
+}
+
+}  // namespace
+
+struct buffer_pool::core {
+    explicit core(limits l)
+        : lim(l), free(size_class(l.max_capacity) + 1, nullptr) {}
+
+    limits const lim;
+    buffer_pool_metrics metrics;
+    // the pool and every pooled buffer handed out
+    std::atomic<std::size_t> refs{1};
+
+    std::mutex mutex;
+    // by size class, linked through block::next
+    std::vector<block*> free;
+    std::size_t cached{0};
+    bool closed{false};
+
+    // requires the lock to be held
+    void clear() {
+        for (auto& head : free) {
+            while (auto b = head) {
+                head = b->next;
+                b->~block();
+                ::operator delete(b);
+            }
+        }
+        cached = 0;
+    }
+
+    void unref() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+};
+
+buffer_pool::buffer_pool() : buffer_pool(limits{}) {}
+
+buffer_pool::buffer_pool(limits l) : core_(new core{l}) {}
+
+buffer_pool::~buffer_pool() {
+    {
+        std::lock_guard<std::mutex> lock{core_->mutex};
+        core_->closed = true;
+        core_->clear();
+    }
+    core_->unref();
+}
+
+auto buffer_pool::buffer::allocate(std::size_t size) -> buffer {
+    return buffer{allocate_block(size, nullptr)};
+}
+
+auto buffer_pool::acquire(std::size_t size) -> buffer {
+    auto& c = *core_;
+    if (size > c.lim.max_capacity) {
+        c.metrics.misses.add();
+        return buffer{allocate_block(size, nullptr)};
+    }
+
+    auto index = size_class(size);
+    block* b = nullptr;
+    {
+        std::lock_guard<std::mutex> lock{c.mutex};
+        if ((b = c.free[index])) {
+            c.free[index] = b->next;
+            c.cached -= b->capacity;
+        }
+    }
+    c.refs.fetch_add(1, std::memory_order_relaxed);
+    if (b) {
+        c.metrics.hits.add();
+        b->refs.store(1, std::memory_order_relaxed);
+        return buffer{b};
+    }
+    c.metrics.misses.add();
+    return buffer{allocate_block(min_capacity << index, core_)};
+}
+
+void buffer_pool::trim() {
+    std::lock_guard<std::mutex> lock{core_->mutex};
+    core_->clear();
+}
+
+auto buffer_pool::get_limits() const -> limits const& {
+    return core_->lim;
+}
+
+std::size_t buffer_pool::cached_bytes() const {
+    std::lock_guard<std::mutex> lock{core_->mutex};
+    return core_->cached;
+}
+
+buffer_pool_metrics const& buffer_pool::metrics() const {
+    return core_->metrics;
+}
+
+auto buffer_pool::allocate_block(std::size_t capacity, core* owner)
+    -> block* {
+    return new (::operator new(sizeof(block) + capacity))
+        block{capacity, owner};
+}
+
+void buffer_pool::release(block* b) {
+    auto owner = b->owner;
+    if (owner) {
+        std::unique_lock<std::mutex> lock{owner->mutex};
+        if (!owner->closed &&
+            owner->cached + b->capacity <= owner->lim.max_bytes) {
+            auto& head = owner->free[size_class(b->capacity)];
+            b->next = head;
+            head = b;
+            owner->cached += b->capacity;
+            lock.unlock();
+            owner->metrics.recycled.add();
+            owner->unref();
+            return;
+        }
+        lock.unlock();
+        owner->metrics.freed.add();
+    }
+    b->~block();
+    ::operator delete(b);
+    if (owner) {
+        owner->unref();
+    }
+}
+
+}  // namespace mosquittoasio
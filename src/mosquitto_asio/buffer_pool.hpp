@@ -0,0 +1,130 @@
+#pragma once
+
+#include "metrics.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace mosquittoasio {
+
+struct buffer_pool_metrics {
+    // buffers taken from the pool and allocated from the heap
+    metrics::counter hits;
+    metrics::counter misses;
+    // released buffers kept by the pool, and freed since the pool was full,
+    // closed or the buffer too large
+    metrics::counter recycled;
+    metrics::counter freed;
+
+    template <typename Writer>
+    void visit(Writer& w) const {
+        w.add_counter("hits", "Buffers taken from the pool", hits);
+        w.add_counter("misses", "Buffers allocated from the heap", misses);
+        w.add_counter("recycled", "Released buffers kept by the pool",
+                      recycled);
+        w.add_counter("freed", "Released buffers freed", freed);
+    }
+};
+
+// Reference counted buffers recycled by size class: capacities are powers
+// of two from min_capacity to limits::max_capacity and released buffers are
+// kept on a free list of their class, up to limits::max_bytes overall.
+// Buffers may be released from any thread and may outlive the pool, the
+// ones released after it are freed.
+class buffer_pool {
+    struct core;
+
+    // the data follows the header
+    struct block {
+        block(std::size_t c, core* o) : refs{1}, capacity{c}, owner{o} {}
+
+        std::atomic<std::size_t> refs;
+        std::size_t capacity;
+        // null when not pooled
+        core* owner;
+        block* next{nullptr};
+    };
+
+   public:
+    static constexpr std::size_t min_capacity = 64;
+
+    struct limits {
+        // larger buffers are allocated and freed every time
+        std::size_t max_capacity{64 * 1024};
+        // capacity kept by the free lists, zero keeps nothing
+        std::size_t max_bytes{1024 * 1024};
+    };
+
+    // a shared buffer, copies refer to the same bytes
+    class buffer {
+       public:
+        buffer() = default;
+        ~buffer() { reset(); }
+
+        buffer(buffer const& other) : block_(other.block_) {
+            if (block_) {
+                block_->refs.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        buffer(buffer&& other) noexcept : block_(other.block_) {
+            other.block_ = nullptr;
+        }
+        buffer& operator=(buffer other) noexcept {
+            std::swap(block_, other.block_);
+            return *this;
+        }
+
+        // a buffer of its own, not pooled
+        static buffer allocate(std::size_t size);
+
+        char* data() const {
+            return block_ ? reinterpret_cast<char*>(block_ + 1) : nullptr;
+        }
+        std::size_t capacity() const { return block_ ? block_->capacity : 0; }
+        explicit operator bool() const { return block_ != nullptr; }
+
+        void reset() {
+            if (block_ &&
+                block_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                release(block_);
+            }
+            block_ = nullptr;
+        }
+
+       private:
+        friend class buffer_pool;
+
+        explicit buffer(block* b) : block_(b) {}
+
+        block* block_{nullptr};
+    };
+
+    buffer_pool();
+    explicit buffer_pool(limits l);
+    // frees the free lists
+    ~buffer_pool();
+
+    buffer_pool(buffer_pool const&) = delete;
+    buffer_pool& operator=(buffer_pool const&) = delete;
+
+    // a buffer of at least size bytes
+    buffer acquire(std::size_t size);
+
+    // frees the free lists
+    void trim();
+
+    limits const& get_limits() const;
+    // capacity held by the free lists
+    std::size_t cached_bytes() const;
+    buffer_pool_metrics const& metrics() const;
+
+   private:
+    static block* allocate_block(std::size_t capacity, core* owner);
+    static void release(block* b);
+
+    // shared with the buffers handed out, which keep it alive
+    core* core_;
+};
+
+}  // namespace mosquittoasio
@@ -3,105 +3,529 @@
 #include "error.hpp"
 #include "log.hpp"
 
-#define ENABLE_MOSQUITTO_LOG 1
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// forwards the libmosquitto log lines to the client log
+#ifndef ENABLE_MOSQUITTO_LOG
+#define ENABLE_MOSQUITTO_LOG 0
+#endif
 
 namespace mosquittoasio {
 
-client::client(io_service& io, char const* client_id, bool clean_session)
+#if ENABLE_MOSQUITTO_LOG
+namespace {
+
+log::level mosquitto_log_level(int level) {
+    switch (level) {
+        case MOSQ_LOG_DEBUG:
+            return log::level::debug;
+        case MOSQ_LOG_INFO:
+            return log::level::info;
+        case MOSQ_LOG_NOTICE:
+            return log::level::notice;
+        case MOSQ_LOG_WARNING:
+            return log::level::warning;
+        default:
+            return log::level::error;
+    }
+}
+
+}  // namespace
+#endif
+
+client::client(io_service& io, char const* client_id, bool clean_session,
+               backend b)
     : io_(io),
-      timer_(io),
+      strand_(io),
+      reconnect_timer_(io),
+      misc_timer_(io),
       socket_(io),
-      native_handle_(native::create(client_id, clean_session, this)) {
+      allocator_(std::make_shared<handler_allocator>()),
+      random_(std::random_device{}()) {
+    if (b == backend::asio) {
+        // the transport handlers already run on the strand, connections
+        // are posted to be ordered after the messages already read
+        mqtt::transport::callbacks cb;
+        cb.on_connect = [this](int rc) {
+            strand_.post(bind_allocator([this, rc] { on_connect(rc); }));
+        };
+        cb.on_disconnect = [this](int rc) {
+            strand_.post(bind_allocator([this, rc] { on_disconnect(rc); }));
+        };
+        cb.on_publish = [this](int mid) { on_publish(mid); };
+        cb.on_message = [this](mqtt::publish_packet const& pub) {
+            queue_message(make_message(pub.topic, pub.payload, pub.qos,
+                                       pub.retain, pub.mid));
+        };
+        transport_.reset(new mqtt::transport{
+            io_, strand_, client_id ? client_id : "", clean_session, std::move(cb),
+            metrics_, allocator_});
+        return;
+    }
+
+    native_handle_ = native::create(client_id, clean_session, this);
     set_callbacks();
 }
 
 client::~client() {
+    auto canceled = std::make_error_code(std::errc::operation_canceled);
+    // completed through the executor of each wait, not the client
+    for (auto& waiter : connect_waiters_) {
+        waiter(canceled);
+    }
+    // so are the publishes never written or never acknowledged
+    {
+        std::lock_guard<std::mutex> lock{publish_mutex_};
+        for (auto& p : pending_) {
+            post_completion(p.handler, canceled, 0);
+        }
+        for (auto& i : inflight_) {
+            post_completion(i.second.handler, canceled, i.first);
+        }
+    }
     native::destroy(native_handle_);
 }
 
 void client::set_tls(char const* capath) {
+    if (transport_) {
+        throw std::system_error{make_error_code(errc::not_supported)};
+    }
     native::set_tls(native_handle_, nullptr, capath, nullptr, nullptr, nullptr);
     native::set_tls_opts(native_handle_, 0, nullptr, nullptr);
 }
 
 void client::connect(char const* host, int port, int keep_alive) {
-    auto rc = native::connect(native_handle_, host, port, keep_alive);
-    if (rc) {
-        LOG_ERROR(<< "client::connect; connect failed rc:" << rc
-                  << " msg:" << rc.message());
-        await_timer_reconnect();
+    // the timer is only touched from the strand
+    auto host_copy = std::string(host);
+    strand_.dispatch(bind_allocator([this, host_copy, port, keep_alive] {
+        // supersedes a scheduled reconnection
+        reconnect_timer_.cancel();
+        reconnect_scheduled_ = false;
+
+        if (transport_) {
+            transport_->connect(host_copy, port, keep_alive);
+            return;
+        }
+
+        // the socket is waited on right away, mosquitto writes the connect
+        // packet once it is connected and the connack is read like any
+        // other packet
+        keep_alive_ = keep_alive;
+        auto rc = native::connect_async(native_handle_, host_copy.c_str(),
+                                        port, keep_alive);
+        if (rc && rc != errc::connection_pending) {
+            LOG_ERROR(<< "client::connect; connect failed rc:" << rc
+                      << " msg:" << rc.message());
+            await_timer_reconnect();
+            return;
+        }
+
+        assign_socket();
+    }));
+}
+
+void client::publish(char const* topic, std::string const& payload,
+                     int qos, bool retain) {
+    {
+        std::unique_lock<std::mutex> lock{publish_mutex_};
+        if (tracks_publishes()) {
+            auto p = pending_publish{topic, payload, qos, retain, {}};
+            auto ec = enqueue_publish(p, lock);
+            // a dropped message is not an error for the producer
+            if (ec && ec != std::errc::operation_canceled) {
+                throw std::system_error(ec);
+            }
+            return;
+        }
+    }
+    if (transport_) {
+        transport_->publish(topic, payload, qos, retain);
+    } else {
+        native::publish(native_handle_, nullptr, topic,
+                        payload.size(), payload.c_str(), qos, retain);
+        touch_write();
+    }
+    metrics_.messages_out.add();
+    metrics_.bytes_out.add(std::strlen(topic) + payload.size());
+}
+
+struct client::function_operation final : publish_operation {
+    function_operation(publish_handler_type h, strand_type const& s,
+                       handler_allocator& a)
+        : handler(std::move(h)), strand(s), allocator(a) {}
+
+    void complete(std::error_code ec, int mid) override {
+        auto h = std::move(handler);
+        destroy();
+        h(ec, mid);
+    }
+
+    void post(std::error_code ec, int mid) override {
+        auto h = std::move(handler);
+        auto s = strand;
+        destroy();
+        s.post([h, ec, mid] { h(ec, mid); });
+    }
+
+    void destroy() override {
+        auto& a = allocator;
+        this->~function_operation();
+        a.deallocate(this, sizeof(function_operation));
+    }
+
+    publish_handler_type handler;
+    strand_type strand;
+    handler_allocator& allocator;
+};
+
+void client::async_publish(std::string topic, std::string payload, int qos,
+                           publish_handler_type handler, bool retain) {
+    publish_completion completion;
+    if (handler) {
+        completion =
+            make_publish_completion<function_operation>(std::move(handler));
+    }
+    start_publish(std::move(topic), std::move(payload), qos,
+                  std::move(completion), retain);
+}
+
+void client::start_publish(std::string topic, std::string payload, int qos,
+                           publish_completion handler, bool retain) {
+    auto p = pending_publish{std::move(topic), std::move(payload), qos,
+                             retain, std::move(handler)};
+
+    std::unique_lock<std::mutex> lock{publish_mutex_};
+    auto ec = enqueue_publish(p, lock);
+    if (ec) {
+        post_completion(p.handler, ec, 0);
+    }
+}
+
+void client::set_max_inflight(std::size_t messages, inflight_policy policy) {
+    // keeps mosquitto from queueing what our window already holds back
+    if (native_handle_) {
+        native::set_max_inflight_messages(native_handle_, messages);
+    }
+
+    std::lock_guard<std::mutex> lock{publish_mutex_};
+    max_inflight_ = messages;
+    inflight_policy_ = policy;
+    issue_pending();
+}
+
+void client::set_outbound_limits(outbound_limits limits) {
+    std::lock_guard<std::mutex> lock{publish_mutex_};
+    limits_ = limits;
+    outbound_space_.notify_all();
+}
+
+std::error_code client::enqueue_publish(pending_publish& p,
+                                        std::unique_lock<std::mutex>& lock) {
+    auto bytes = p.topic.size() + p.payload.size();
+    if (limits_.max_bytes && bytes > limits_.max_bytes) {
+        return std::make_error_code(std::errc::message_size);
+    }
+
+    auto window_full = [this] {
+        return max_inflight_ && inflight_.size() >= max_inflight_;
+    };
+    if (inflight_policy_ == inflight_policy::reject && window_full()) {
+        return std::make_error_code(std::errc::operation_would_block);
+    }
+
+    while (!outbound_fits(bytes)) {
+        switch (limits_.policy) {
+            case overflow_policy::fail:
+                return std::make_error_code(std::errc::no_buffer_space);
+            case overflow_policy::drop_newest:
+                return std::make_error_code(std::errc::operation_canceled);
+            case overflow_policy::drop_oldest: {
+                // only what mosquitto does not hold yet can be dropped
+                if (pending_.empty()) {
+                    return std::make_error_code(std::errc::operation_canceled);
+                }
+                auto dropped = std::move(pending_.front());
+                pending_.pop_front();
+                release_outbound(dropped.topic.size() + dropped.payload.size());
+                post_completion(
+                    dropped.handler,
+                    std::make_error_code(std::errc::operation_canceled), 0);
+                break;
+            }
+            case overflow_policy::block:
+                // the space is only freed from the strand
+                if (strand_.running_in_this_thread()) {
+                    return std::make_error_code(
+                        std::errc::resource_deadlock_would_occur);
+                }
+                outbound_space_.wait(lock);
+                break;
+        }
+    }
+
+    outbound_messages_ += 1;
+    outbound_bytes_ += bytes;
+    if (!above_high_watermark_ && outbound_reached(limits_.high_watermark)) {
+        above_high_watermark_ = true;
+        strand_.post(bind_allocator([this] { high_watermark_signal(); }));
+    }
+
+    pending_.push_back(std::move(p));
+    if (!window_full()) {
+        issue_pending();
+    }
+    return {};
+}
+
+bool client::outbound_fits(std::size_t bytes) const {
+    return (!limits_.max_messages ||
+            outbound_messages_ + 1 <= limits_.max_messages) &&
+           (!limits_.max_bytes || outbound_bytes_ + bytes <= limits_.max_bytes);
+}
+
+bool client::outbound_reached(unsigned percent) const {
+    return (limits_.max_messages &&
+            outbound_messages_ * 100 >= limits_.max_messages * percent) ||
+           (limits_.max_bytes &&
+            outbound_bytes_ * 100 >= limits_.max_bytes * percent);
+}
+
+void client::release_outbound(std::size_t bytes) {
+    outbound_messages_ -= 1;
+    outbound_bytes_ -= bytes;
+    outbound_space_.notify_all();
+
+    if (above_high_watermark_ && !outbound_reached(limits_.low_watermark)) {
+        above_high_watermark_ = false;
+        strand_.post(bind_allocator([this] { low_watermark_signal(); }));
+    }
+}
+
+void client::post_completion(publish_completion& handler,
+                             std::error_code ec, int mid) {
+    if (handler) {
+        handler.post(ec, mid);
+    }
+}
+
+void client::issue_publish(pending_publish& p) {
+    // counted before publishing, a qos 0 completion may be called from
+    // inside mosquitto_publish
+    ++async_publishes_;
+
+    auto bytes = p.topic.size() + p.payload.size();
+    auto mid = 0;
+    try {
+        if (transport_) {
+            mid = transport_->publish(p.topic, p.payload, p.qos, p.retain);
+        } else {
+            native::publish(native_handle_, &mid, p.topic.c_str(),
+                            p.payload.size(), p.payload.c_str(), p.qos,
+                            p.retain);
+            touch_write();
+        }
+    } catch (std::system_error const& e) {
+        --async_publishes_;
+        release_outbound(bytes);
+        post_completion(p.handler, e.code(), 0);
         return;
     }
 
-    await_timer_connect();
+    metrics_.messages_out.add();
+    metrics_.bytes_out.add(bytes);
+    if (inflight_.count(mid)) {
+        // the id of a message still awaiting completion was reused, the
+        // completion of this one could not be told apart: it is failed,
+        // though the message went out
+        LOG_ERROR(<< "client::issue_publish; message id " << mid
+                  << " already in flight");
+        --async_publishes_;
+        release_outbound(bytes);
+        post_completion(p.handler, make_error_code(errc::protocol), mid);
+        return;
+    }
+    inflight_.emplace(mid,
+                      inflight_publish{p.qos, bytes, std::move(p.handler)});
 }
 
-void client::publish(char const* topic, std::string const& payload,
-                     int qos, bool retain) {
-    native::publish(native_handle_, nullptr, topic,
-                    payload.size(), payload.c_str(), qos, retain);
+void client::issue_pending() {
+    while (!pending_.empty() &&
+           (!max_inflight_ || inflight_.size() < max_inflight_)) {
+        auto p = std::move(pending_.front());
+        pending_.pop_front();
+        issue_publish(p);
+    }
+}
+
+void client::set_write_budget(std::size_t packets) {
+    // mosquitto writes its whole queue on every loop_write
+    if (transport_) {
+        transport_->set_write_budget(packets);
+    }
+}
+
+void client::cork() {
+    if (transport_) {
+        transport_->cork();
+        return;
+    }
+    // a threaded handle only queues the packets, leaving the writing to us;
+    // mosquitto reads the flag unlocked when queueing, so it is only
+    // toggled from the strand
+    strand_.dispatch(bind_allocator([this] {
+        if (corked_++ == 0) {
+            native::set_threaded(native_handle_, true);
+        }
+    }));
+}
+
+void client::uncork() {
+    if (transport_) {
+        transport_->uncork();
+        return;
+    }
+    strand_.dispatch(bind_allocator([this] {
+        if (--corked_ == 0) {
+            native::set_threaded(native_handle_, false);
+            flush();
+        }
+    }));
 }
 
 void client::send_subscribe(std::string const& topic, int qos) {
-    native::subscribe(native_handle_, nullptr, topic.c_str(), qos);
+    // the connection state is only touched from the strand; what is dropped
+    // while disconnected is subscribed again on connection
+    strand_.dispatch(bind_allocator([this, topic, qos] {
+        if (!connected_) {
+            return;
+        }
+        if (transport_) {
+            transport_->subscribe(topic, qos);
+            return;
+        }
+        auto rc = native::subscribe(native_handle_, nullptr, topic.c_str(), qos);
+        if (rc) {
+            LOG_DEBUG(<< "client::send_subscribe; dropped topic:\"" << topic
+                      << "\" rc:" << rc.message());
+            return;
+        }
+        touch_write();
+    }));
 }
 
 void client::send_unsubscribe(std::string const& topic) {
-    native::unsubscribe(native_handle_, nullptr, topic.c_str());
+    strand_.dispatch(bind_allocator([this, topic] {
+        if (!connected_) {
+            return;
+        }
+        if (transport_) {
+            transport_->unsubscribe(topic);
+            return;
+        }
+        auto rc = native::unsubscribe(native_handle_, nullptr, topic.c_str());
+        if (rc) {
+            LOG_DEBUG(<< "client::send_unsubscribe; dropped topic:\"" << topic
+                      << "\" rc:" << rc.message());
+            return;
+        }
+        touch_write();
+    }));
 }
 
 void client::await_timer_reconnect() {
-    using boost::posix_time::seconds;
-    timer_.expires_from_now(seconds(5));
-    timer_.async_wait([this](error_code ec) { handle_timer_reconnect(ec); });
-}
-
-void client::handle_timer_reconnect(error_code ec) {
-    if (ec == boost::system::errc::operation_canceled) {
+    // a failure may be reported both by a loop function and by the
+    // disconnect callback
+    if (reconnect_scheduled_) {
         return;
     }
-    if (ec) {
-        throw boost::system::system_error(ec);
+    reconnect_scheduled_ = true;
+    auto now = metrics::clock::now();
+    if (connected_since_ != metrics::clock::time_point{}) {
+        // a broker dropping every connection right away keeps being backed
+        // off instead of being reconnected to with the first delay
+        if (now - connected_since_ >= reconnect_policy_.stable_after) {
+            reconnect_attempts_ = 0;
+        }
+        connected_since_ = {};
     }
-    auto rc = native::reconnect(native_handle_);
-    if (rc) {
-        LOG_ERROR(<< "client::handle_timer_reconnect; reconnect failed ec:"
-                  << rc << " msg:" << rc.message());
-        await_timer_reconnect();
-        return;
+    if (!reconnect_attempts_) {
+        failed_since_ = now;
     }
-    await_timer_connect();
+    auto attempt = ++reconnect_attempts_;
+    auto delay = reconnect_delay(attempt);
+    LOG_DEBUG(<< "client::await_timer_reconnect; attempt " << attempt
+              << " in " << delay.count() << "ms");
+
+    reconnect_timer_.expires_from_now(delay);
+    reconnect_timer_.async_wait(
+        strand_.wrap(bind_allocator(
+            [this](error_code ec) { handle_timer_reconnect(ec); })));
+    reconnect_scheduled_signal(attempt, delay);
 }
 
-void client::await_timer_connect() {
-    using boost::posix_time::milliseconds;
-    timer_.expires_from_now(milliseconds(100));
-    timer_.async_wait([this](error_code ec) { handle_timer_connect(ec); });
+std::chrono::milliseconds client::reconnect_delay(unsigned attempt) {
+    auto const& p = reconnect_policy_;
+    auto delay = static_cast<double>(p.first_delay.count());
+    if (attempt > 1) {
+        delay = static_cast<double>(p.base_delay.count()) *
+                std::pow(p.multiplier, attempt - 2);
+        delay = std::min(delay, static_cast<double>(p.max_delay.count()));
+    }
+    auto jitter = std::min(std::max(p.jitter, 0.0), 1.0);
+    std::uniform_real_distribution<double> spread{1 - jitter, 1};
+    return std::chrono::milliseconds{
+        static_cast<std::chrono::milliseconds::rep>(delay * spread(random_))};
 }
 
-void client::handle_timer_connect(error_code ec) {
+void client::handle_timer_reconnect(error_code ec) {
     if (ec == boost::system::errc::operation_canceled) {
         return;
     }
+    reconnect_scheduled_ = false;
     if (ec) {
         throw boost::system::system_error(ec);
     }
+    metrics_.reconnect_attempts.add();
+    if (transport_) {
+        // the transport reports the outcome through on_connect
+        transport_->reconnect();
+        return;
+    }
 
-    auto rc = native::loop(native_handle_);
-    if (rc == errc::connection_lost) {
+    auto rc = native::reconnect_async(native_handle_);
+    if (rc && rc != errc::connection_pending) {
+        LOG_ERROR(<< "client::handle_timer_reconnect; reconnect failed ec:"
+                  << rc << " msg:" << rc.message());
         await_timer_reconnect();
         return;
-    } else if (rc) {
-        throw std::system_error(rc);
     }
-
-    await_timer_connect();
+    assign_socket();
 }
 
 void client::await_timer_misc() {
-    using boost::posix_time::seconds;
-    timer_.expires_from_now(seconds(1));
-    timer_.async_wait([this](error_code ec) { handle_timer_misc(ec); });
+    if (!keep_alive_) {
+        return;
+    }
+    misc_timer_.expires_at(misc_deadline());
+    misc_timer_.async_wait(
+        strand_.wrap(bind_allocator(
+            [this](error_code ec) { handle_timer_misc(ec); })));
+}
+
+metrics::clock::time_point client::misc_deadline() const {
+    // mosquitto pings once keep_alive passed since it last read or wrote,
+    // counting whole seconds, a second later it surely sees it passed
+    auto last = std::min(last_read_,
+                         last_write_.load(std::memory_order_relaxed));
+    return last + std::chrono::seconds(keep_alive_ + 1);
 }
 
 void client::handle_timer_misc(error_code ec) {
@@ -111,14 +535,22 @@ void client::handle_timer_misc(error_code ec) {
         throw boost::system::system_error(ec);
     }
 
+    // packets read or written since arming moved the deadline
+    auto now = metrics::clock::now();
+    if (misc_deadline() > now) {
+        await_timer_misc();
+        return;
+    }
+
     auto rc = native::loop_misc(native_handle_);
-    if (rc == errc::connection_lost) {
-        await_timer_reconnect();
+    if (rc) {
+        handle_loop_error(rc);
         return;
-    } else if (rc) {
-        throw std::system_error(rc);
     }
 
+    // mosquitto pinged, restarting both periods to await the response
+    last_read_ = now;
+    last_write_.store(now, std::memory_order_relaxed);
     await_timer_misc();
 
     // the misc loop may create the need of writting
@@ -128,7 +560,8 @@ void client::handle_timer_misc(error_code ec) {
 void client::await_read() {
     socket_.async_read_some(
         boost::asio::null_buffers(),
-        [this](error_code ec, int) { handle_read(ec); });
+        strand_.wrap(bind_allocator(
+            [this](error_code ec, int) { handle_read(ec); })));
 }
 
 void client::handle_read(error_code ec) {
@@ -138,17 +571,43 @@ void client::handle_read(error_code ec) {
     if (ec) {
         throw boost::system::system_error(ec);
     }
+    read_packets();
+}
 
-    auto rc = native::loop_read(native_handle_);
-    if (rc == errc::connection_lost) {
-        await_timer_reconnect();
-        return;
-    } else if (rc) {
-        throw std::system_error(rc);
+void client::read_packets() {
+    // drain the packets already available, up to the budget, instead of
+    // waiting for another readiness event for each one of them; mosquitto
+    // reads a single packet per call whatever max_packets says, and returns
+    // success alike once the socket would block, hence the peek
+    auto drained = false;
+    for (std::size_t packets = 1; !drained; ++packets) {
+        metrics_.socket_reads.add();
+        auto rc = native::loop_read(native_handle_);
+        if (rc) {
+            handle_loop_error(rc);
+            return;
+        }
+        drained = !socket_readable();
+        if (packets >= read_budget_) {
+            break;
+        }
+    }
+    last_read_ = metrics::clock::now();
+
+    if (drained) {
+        // we want to be always ready for a read
+        await_read();
+    } else {
+        // the reactor is edge triggered, the packets left would wait for
+        // the next ones to arrive; they are read after the handlers queued
+        // meanwhile instead
+        auto generation = socket_generation_;
+        strand_.post(bind_allocator([this, generation] {
+            if (generation == socket_generation_) {
+                read_packets();
+            }
+        }));
     }
-
-    // we want to be always ready for a read
-    await_read();
 
     // receiving entry may create a need of writing
     await_write();
@@ -166,7 +625,8 @@ void client::await_write() {
     writting_ = true;
     socket_.async_write_some(
         boost::asio::null_buffers(),
-        [this](error_code ec, int) { handle_write(ec); });
+        strand_.wrap(bind_allocator(
+            [this](error_code ec, int) { handle_write(ec); })));
 }
 
 void client::handle_write(error_code ec) {
@@ -178,32 +638,96 @@ void client::handle_write(error_code ec) {
         throw boost::system::system_error(ec);
     }
 
+    metrics_.socket_writes.add();
     auto rc = native::loop_write(native_handle_);
-    if (rc == errc::connection_lost) {
-        await_timer_reconnect();
+    if (rc) {
+        handle_loop_error(rc);
         return;
-    } else if (rc) {
-        throw std::system_error(rc);
     }
+    touch_write();
 
     // there may be more to be written, so we schedule a write again
     await_write();
 }
 
+void client::flush() {
+    // corked again before we got here, the next uncork flushes
+    if (!connected_ || corked_) {
+        return;
+    }
+
+    // writes everything queued until the socket would block
+    set_socket_cork(true);
+    metrics_.socket_writes.add();
+    auto rc = native::loop_write(native_handle_,
+                                 std::numeric_limits<int>::max());
+    set_socket_cork(false);
+
+    if (rc) {
+        handle_loop_error(rc);
+        return;
+    }
+    touch_write();
+
+    await_write();
+}
+
+bool client::socket_readable() {
+    // a peek would block once the socket is drained; a closed connection
+    // reads as readable so the next loop_read reports it
+    char byte;
+    auto n = ::recv(socket_.native_handle(), &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+void client::set_socket_cork([[gnu::unused]] bool cork) {
+#ifdef TCP_CORK
+    // best effort, it fails on non tcp sockets and the data still goes out
+    int value = cork;
+    ::setsockopt(socket_.native_handle(), IPPROTO_TCP, TCP_CORK,
+                 &value, sizeof(value));
+#endif
+}
+
+void client::handle_loop_error(std::error_code rc) {
+    // a connection attempt failing or an established connection dropping,
+    // mosquitto already closed the socket
+    if (rc != errc::connection_lost && rc != errc::connection_refused &&
+        rc != errc::no_connection && rc != errc::errno_) {
+        throw std::system_error(rc);
+    }
+    LOG_ERROR(<< "client::handle_loop_error; connection failed rc:" << rc
+              << " msg:" << rc.message());
+    release_socket();
+    await_timer_reconnect();
+}
+
 void client::assign_socket() {
+    // a reconnection may have replaced the socket
+    release_socket();
+    writting_ = false;
+
     auto native_socket = native::get_socket(native_handle_);
     socket_.assign(native_socket);
 
     // Put the socket into non-blocking mode.
     socket_.non_blocking(true);
 
+    last_read_ = metrics::clock::now();
+    last_write_.store(last_read_, std::memory_order_relaxed);
+
     await_read();
     await_write();
     await_timer_misc();
 }
 
 void client::release_socket() {
-    socket_.release();
+    // cancels the pending waits, mosquitto owns the descriptor
+    if (socket_.is_open()) {
+        socket_.release();
+    }
+    ++socket_generation_;
+    misc_timer_.cancel();
 }
 
 void client::set_callbacks() {
@@ -215,54 +739,113 @@ void client::set_callbacks() {
         native_handle_,
         [](handle_type*, void* user_data, int rc) {
             auto this_ = static_cast<client*>(user_data);
-            this_->io_.post([this_, rc] { this_->on_connect(rc); });
+            this_->strand_.post(
+                this_->bind_allocator([this_, rc] { this_->on_connect(rc); }));
+        });
+
+    native::set_publish_callback(
+        native_handle_,
+        [](handle_type*, void* user_data, int mid) {
+            auto this_ = static_cast<client*>(user_data);
+            if (this_->async_publishes_) {
+                this_->strand_.post(this_->bind_allocator(
+                    [this_, mid] { this_->on_publish(mid); }));
+            }
         });
 
     native::set_disconnect_callback(
         native_handle_,
         [](handle_type*, void* user_data, int rc) {
             auto this_ = static_cast<client*>(user_data);
-            this_->io_.post([this_, rc] { this_->on_disconnect(rc); });
+            this_->strand_.post(this_->bind_allocator(
+                [this_, rc] { this_->on_disconnect(rc); }));
         });
 
     native::set_message_callback(
         native_handle_,
         [](handle_type*, void* user_data, native::message_type const* msg) {
             auto this_ = static_cast<client*>(user_data);
-            auto topic = std::string(msg->topic);
-            auto payload = std::string(static_cast<char const*>(msg->payload),
-                                       msg->payloadlen);
-            this_->io_.post([this_, topic, payload] {
-                this_->on_message(topic, payload);
-            });
+            auto payload = message::string_view{
+                static_cast<char const*>(msg->payload),
+                static_cast<std::size_t>(msg->payloadlen)};
+            this_->queue_message(this_->make_message(
+                msg->topic, payload, msg->qos, msg->retain, msg->mid));
         });
 
 #if ENABLE_MOSQUITTO_LOG
     native::set_log_callback(
         native_handle_,
         [](handle_type*, void* user_data, int level, char const* str) {
+            // skips copying and posting the lines that would be filtered
+            if (!log::enabled(mosquitto_log_level(level))) {
+                return;
+            }
             auto this_ = static_cast<client*>(user_data);
             auto message = std::string(str);
-            this_->io_.post([this_, level, message] {
-                this_->on_log(level, message);
-            });
+            this_->strand_.post(
+                this_->bind_allocator([this_, level, message] {
+                    this_->on_log(level, message);
+                }));
         });
 #endif
 }
 void client::on_connect(int rc) {
     if (rc) {
-        LOG_ERROR(<< "client::on_connect; connection refused code=" << rc);
+        LOG_ERROR(<< "client::on_connect; connection failed code=" << rc);
         await_timer_reconnect();
         return;
     }
 
     LOG_VERBOSE(<< "client::on_connect; connected");
 
+    metrics_.connects.add();
     connected_ = true;
-    assign_socket();
 
-    publish("mosquitto-asio-test", "connected!", 0, false);
+    // the attempts are kept until the connection proves stable
+    auto attempts = reconnect_attempts_;
+    connected_since_ = metrics::clock::now();
+
+    // the window may have been freed by qos 0 messages lost on disconnection
+    {
+        std::lock_guard<std::mutex> lock{publish_mutex_};
+        issue_pending();
+    }
+
     connected_signal();
+
+    auto waiters = std::move(connect_waiters_);
+    connect_waiters_.clear();
+    for (auto& waiter : waiters) {
+        waiter(std::error_code{});
+    }
+
+    if (attempts) {
+        auto downtime = metrics::elapsed_ns(failed_since_);
+        metrics_.recovery_time_ns.record(downtime);
+        reconnected_signal(attempts,
+                           std::chrono::duration_cast<std::chrono::milliseconds>(
+                               std::chrono::nanoseconds(downtime)));
+    }
+}
+
+void client::on_publish(int mid) {
+    publish_completion handler;
+    {
+        std::lock_guard<std::mutex> lock{publish_mutex_};
+        auto it = inflight_.find(mid);
+        if (it == inflight_.end()) {
+            // a plain publish
+            return;
+        }
+        handler = std::move(it->second.handler);
+        release_outbound(it->second.bytes);
+        inflight_.erase(it);
+        --async_publishes_;
+        issue_pending();
+    }
+    if (handler) {
+        handler.complete({}, mid);
+    }
 }
 
 void client::on_disconnect(int rc) {
@@ -273,8 +856,34 @@ void client::on_disconnect(int rc) {
         return;
     }
 
+    metrics_.disconnects.add();
     connected_ = false;
-    release_socket();
+    if (!transport_) {
+        release_socket();
+    }
+
+    // mosquitto drops the unwritten qos 0 packets, qos 1 and 2 messages are
+    // sent again after reconnecting
+    std::vector<std::pair<int, publish_completion>> lost;
+    {
+        std::lock_guard<std::mutex> lock{publish_mutex_};
+        for (auto it = inflight_.begin(); it != inflight_.end();) {
+            if (it->second.qos) {
+                ++it;
+                continue;
+            }
+            if (it->second.handler) {
+                lost.emplace_back(it->first, std::move(it->second.handler));
+            }
+            release_outbound(it->second.bytes);
+            it = inflight_.erase(it);
+            --async_publishes_;
+        }
+    }
+    for (auto& l : lost) {
+        l.second.complete(make_error_code(errc::connection_lost), l.first);
+    }
+
     disconnected_signal();
 
     if (rc) {
@@ -286,11 +895,58 @@ void client::on_disconnect(int rc) {
     LOG_INFO(<< "client::on_disconnect; disconnected as expected");
 }
 
-void client::on_message(std::string const& topic, std::string const& payload) {
-    LOG_INFO(<< "client::on_message; topic:\"" << topic
-             << "\" payload:\"" << payload << '\"');
+void client::enable_topic_interning(std::size_t max_topics) {
+    topics_.reset(new topic_table{max_topics});
+}
+
+void client::enable_buffer_pool(buffer_pool::limits limits) {
+    buffers_.reset(new buffer_pool{limits});
+}
+
+message client::make_message(message::string_view topic,
+                             message::string_view payload, int qos,
+                             bool retain, int mid) {
+    if (topics_) {
+        auto id = topics_->intern(topic);
+        if (id != invalid_topic_id) {
+            return message{topics_->name(id), payload, qos, retain, mid, id,
+                           buffers_.get()};
+        }
+    }
+    return message{topic, payload, qos, retain, mid, invalid_topic_id,
+                   buffers_.get()};
+}
+
+void client::queue_message(message msg) {
+    metrics_.messages_in.add();
+    metrics_.bytes_in.add(msg.topic().size() + msg.payload().size());
+
+    // messages read in a row are delivered by a single posted work
+    inbound_.push_back(std::move(msg));
+    if (inbound_.size() == 1) {
+        inbound_since_ = metrics::clock::now();
+        strand_.post(bind_allocator([this] { deliver_messages(); }));
+    }
+}
+
+void client::deliver_messages() {
+    delivering_.swap(inbound_);
+    auto queued = metrics::elapsed_ns(inbound_since_);
+    for (auto const& msg : delivering_) {
+        metrics_.delivery_latency_ns.record(queued);
+        on_message(msg);
+    }
+    // keeps the capacity for the next batch
+    delivering_.clear();
+}
+
+void client::on_message(message const& msg) {
+    LOG_VERBOSE(<< "client::on_message; topic:\"" << msg.topic()
+                << "\" payload size:" << msg.payload().size());
 
-    message_received_signal(topic, payload);
+    auto start = metrics::clock::now();
+    message_received_signal(msg);
+    metrics_.handler_latency_ns.record(metrics::elapsed_ns(start));
 }
 
 void client::on_log([[gnu::unused]] int level,
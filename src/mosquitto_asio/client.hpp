@@ -1,65 +1,274 @@
 #pragma once
 
+#include "buffer_pool.hpp"
+#include "completion.hpp"
+#include "handler_allocator.hpp"
+#include "message.hpp"
+#include "metrics.hpp"
+#include "mqtt_transport.hpp"
 #include "native.hpp"
+#include "signal.hpp"
 #include "subscription.hpp"
+#include "timer_wheel.hpp"
 
 #include <boost/asio.hpp>
-#include <boost/signals2.hpp>
+#include <boost/container/deque.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace mosquittoasio {
 
 class client {
    public:
     using io_service = boost::asio::io_service;
+    using strand_type = io_service::strand;
     using handle_type = native::handle_type;
 
-    using connected_signal_type = boost::signals2::signal<void()>;
-    using disconnected_signal_type = boost::signals2::signal<void()>;
-    using message_received_signal_type = boost::signals2::signal<
-        void(std::string const& topic, std::string const& payload)>;
+    // allocated by their first connection, a client nobody listens to
+    // carries a pointer for each
+    using connected_signal_type = lazy_signal<void()>;
+    using disconnected_signal_type = lazy_signal<void()>;
+    using message_received_signal_type = lazy_signal<void(message const&)>;
+
+    using publish_handler_type = std::function<void(std::error_code, int mid)>;
+
+    // std::function and function pointers go to the std::function overload
+    // of async_publish, every other callable to the completion token one,
+    // which keeps its associated executor and allocator
+    template <typename T>
+    struct is_publish_handler
+        : std::integral_constant<
+              bool,
+              std::is_same<typename std::decay<T>::type,
+                           publish_handler_type>::value ||
+                  (std::is_pointer<typename std::decay<T>::type>::value &&
+                   std::is_convertible<T, publish_handler_type>::value)> {};
+
+    // what async_publish does once the in-flight window is full
+    enum class inflight_policy { queue, reject };
+
+    // what a publish does once the outbound buffer is full
+    enum class overflow_policy { block, drop_oldest, drop_newest, fail };
+
+    // bounds the messages published and not yet completed, both the ones
+    // queued by the client and the ones held by mosquitto; zero is unlimited
+    struct outbound_limits {
+        std::size_t max_messages{0};
+        std::size_t max_bytes{0};
+        overflow_policy policy{overflow_policy::fail};
+        // percentages of the limits emitting the watermark signals
+        unsigned high_watermark{80};
+        unsigned low_watermark{50};
+    };
+
+    // the connection is driven either by libmosquitto or by the MQTT 3.1.1
+    // implementation over asio sockets, which does not support TLS
+    enum class backend { native, asio };
+
+    // spaces the reconnection attempts once the connection failed: the
+    // first one waits first_delay, the second base_delay and every next one
+    // multiplier times longer, up to max_delay; jitter is the fraction of
+    // each delay drawn at random, so clients failing together spread out.
+    // The attempts only start over once a connection stayed up for
+    // stable_after, one dropped sooner counts as a failed attempt
+    struct reconnect_policy {
+        std::chrono::milliseconds first_delay{0};
+        std::chrono::milliseconds base_delay{1000};
+        std::chrono::milliseconds max_delay{30000};
+        double multiplier{2};
+        double jitter{0.5};
+        std::chrono::milliseconds stable_after{10000};
+    };
 
-    client(io_service& io, char const* client_id = nullptr, bool clean_session = true);
+    client(io_service& io, char const* client_id = nullptr, bool clean_session = true,
+           backend b = backend::native);
     ~client();
 
-    client(client&&) = default;
-    client& operator=(client&&) = default;
+    // handlers and signal slots capture the client
+    client(client const&) = delete;
+    client& operator=(client const&) = delete;
+    client(client&&) = delete;
+    client& operator=(client&&) = delete;
 
     void set_tls(char const* capath);
     void connect(char const* host, int port, int keep_alive);
 
+    // connects and completes with (std::error_code) once connected, the
+    // failed attempts in between being retried by the reconnect policy; the
+    // token is a callback, called on the strand, use_future, a yield_context
+    // or use_awaitable. Waits still pending when the client is destroyed
+    // complete with operation_canceled
+    template <typename CompletionToken>
+    auto async_connect(std::string host, int port, int keep_alive,
+                       CompletionToken&& token)
+        -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken,
+                                         void(std::error_code));
+
     bool is_connected() const { return connected_; }
 
     io_service& io() { return io_; }
+    // every internal handler and signal of the client runs on this strand
+    strand_type& strand() { return strand_; }
+    // null on the asio backend
     handle_type* native() { return native_handle_; }
 
+    // asio takes the storage of the bound handler from the handler
+    // allocator of the client, which recycles it, instead of the heap; every
+    // internal handler of the client is bound
+    template <typename Handler>
+    allocating_handler<typename std::decay<Handler>::type> bind_allocator(
+        Handler&& handler) {
+        return make_allocating_handler(allocator_,
+                                       std::forward<Handler>(handler));
+    }
+    handler_allocator const& allocator() const { return *allocator_; }
+
+    // must be called before connecting
+    void set_reconnect_policy(reconnect_policy policy) {
+        reconnect_policy_ = policy;
+    }
+
+    // maximum number of packets read in a row before letting the other
+    // handlers run, 16 by default; reading stops earlier once the socket
+    // would block
+    void set_read_budget(std::size_t packets) { read_budget_ = packets; }
+    // maximum number of packets gathered on each write, only on the asio
+    // backend; mosquitto always writes everything it has queued
+    void set_write_budget(std::size_t packets);
+
+    // interns the topics of inbound messages, up to max_topics, so they
+    // carry a dense topic id and view the interned name instead of copying
+    // it; must be called before connecting
+    void enable_topic_interning(std::size_t max_topics);
+    // null unless interning is enabled
+    topic_table* topics() { return topics_.get(); }
+
+    // takes the buffers of inbound messages from a pool of the client, they
+    // go back to it once the last copy of a message is destroyed, so
+    // receiving at a steady rate allocates nothing; must be called before
+    // connecting
+    void enable_buffer_pool(buffer_pool::limits limits = buffer_pool::limits{});
+    // null unless pooling is enabled
+    buffer_pool* buffers() { return buffers_.get(); }
+
+    // publishes issued while corked are only queued, uncorking writes them
+    // in a row with the socket corked so they leave in as few segments as
+    // possible; cork and uncork calls nest. On the native backend they take
+    // effect on the strand, a burst published from another thread may
+    // start leaving before the cork is in place
+    void cork();
+    void uncork();
+
     void publish(char const* topic, std::string const& payload, int qos, bool retain = false);
 
+    // the handler is called on the strand with the message id once the
+    // message is written (qos 0) or acknowledged (qos 1 and 2); qos 0
+    // messages still unwritten on a disconnection fail with connection_lost,
+    // a message given the id of one still in flight fails with protocol,
+    // messages still queued or in flight when the client is destroyed
+    // with operation_canceled
+    void async_publish(std::string topic, std::string payload, int qos,
+                       publish_handler_type handler, bool retain = false);
+
+    // the same taking a completion token instead of a handler, completing
+    // with (std::error_code, int mid) through the executor associated with
+    // the token, the strand for a plain callback; any callable other than a
+    // std::function or a function pointer is taken as a token
+    template <typename CompletionToken>
+    auto async_publish(std::string topic, std::string payload, int qos,
+                       CompletionToken&& token, bool retain = false) ->
+        typename std::enable_if<
+            !is_publish_handler<CompletionToken>::value,
+            BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken,
+                                          void(std::error_code, int))>::type;
+
+    // limits the publishes awaiting completion, zero is unlimited;
+    // once full they are queued or rejected with operation_would_block
+    void set_max_inflight(std::size_t messages,
+                          inflight_policy policy = inflight_policy::queue);
+    std::size_t inflight_count() const { return async_publishes_; }
+
+    // once full, block waits for space (failing with
+    // resource_deadlock_would_occur on the strand), drop_oldest drops the
+    // oldest message not yet handed to mosquitto, drop_newest drops the
+    // message being published and fail fails it with no_buffer_space;
+    // dropped messages complete with operation_canceled.
+    // Messages are only held back by the client while the in-flight window
+    // is full, so drop_oldest needs set_max_inflight: without a window every
+    // message is handed to mosquitto right away and drop_oldest drops the
+    // newest one. Space is freed by completions running on the strand, so
+    // block needs another thread running the io_service: a publish from a
+    // handler of any client of a single threaded io_service waits forever
+    void set_outbound_limits(outbound_limits limits);
+
+    // counters and latencies, readable from any thread, see metrics::to_json
+    // and metrics::to_prometheus
+    client_metrics const& metrics() const { return metrics_; }
+
+    // may be called from any thread, they run on the strand and are dropped
+    // while disconnected
     void send_subscribe(std::string const& topic, int qos);
     void send_unsubscribe(std::string const& topic);
 
     connected_signal_type connected_signal;
     disconnected_signal_type disconnected_signal;
     message_received_signal_type message_received_signal;
+    // the outbound buffer went above the high watermark and back below the
+    // low watermark
+    lazy_signal<void()> high_watermark_signal;
+    lazy_signal<void()> low_watermark_signal;
+    // a reconnection is scheduled, with the number of the attempt since the
+    // connection failed, starting at 1, and the delay before it
+    lazy_signal<void(unsigned attempt, std::chrono::milliseconds delay)>
+        reconnect_scheduled_signal;
+    // connected after failing, with the attempts it took and the time since
+    // the failure
+    lazy_signal<void(unsigned attempts, std::chrono::milliseconds downtime)>
+        reconnected_signal;
 
    private:
     using error_code = boost::system::error_code;
 
-    using timer_type = boost::asio::deadline_timer;
+    using timer_type = wheel_timer;
     using socket_type = boost::asio::posix::stream_descriptor;
 
     void await_timer_reconnect();
+    std::chrono::milliseconds reconnect_delay(unsigned attempt);
     void handle_timer_reconnect(error_code ec);
 
-    void await_timer_connect();
-    void handle_timer_connect(error_code ec);
-
+    // keep alive processing, only due once the keep alive period passed
+    // since the last packet read or written
     void await_timer_misc();
     void handle_timer_misc(error_code ec);
+    metrics::clock::time_point misc_deadline() const;
+    void touch_write() {
+        last_write_.store(metrics::clock::now(), std::memory_order_relaxed);
+    }
 
     void await_read();
     void handle_read(error_code ec);
+    void read_packets();
     void await_write();
     void handle_write(error_code ec);
+    void flush();
+    // whether a read would not block, without consuming anything
+    bool socket_readable();
+    void set_socket_cork(bool cork);
+
+    // reconnects on connection errors and throws on any other
+    void handle_loop_error(std::error_code rc);
 
     void assign_socket();
     void release_socket();
@@ -68,16 +277,278 @@ class client {
 
     void on_connect(int rc);
     void on_disconnect(int rc);
-    void on_message(std::string const& topic, std::string const& payload);
+
+    struct initiate_connect {
+        client* self;
+
+        template <typename Handler>
+        void operator()(Handler&& handler, std::string host, int port,
+                        int keep_alive) const;
+    };
+
+    struct initiate_publish {
+        client* self;
+
+        template <typename Handler>
+        void operator()(Handler&& handler, std::string topic,
+                        std::string payload, int qos, bool retain) const;
+    };
+
+    // a publish completion, type erased once per operation and stored by
+    // the allocator of the client, which recycles it; complete, post and
+    // destroy free the operation
+    struct publish_operation {
+        // called on the strand
+        virtual void complete(std::error_code ec, int mid) = 0;
+        // called from any thread, never calls the handler from inside
+        virtual void post(std::error_code ec, int mid) = 0;
+        virtual void destroy() = 0;
+
+       protected:
+        ~publish_operation() = default;
+    };
+
+    // a handler given as a std::function, called on the strand
+    struct function_operation;
+
+    // a handler made from a completion token, completed through its
+    // associated executor, the strand by default
+    template <typename Handler>
+    struct token_operation final : publish_operation {
+        token_operation(Handler h, strand_type const& s, handler_allocator& a)
+            : handler(std::move(h)), strand(s), allocator(a) {}
+
+        void complete(std::error_code ec, int mid) override { post(ec, mid); }
+
+        void post(std::error_code ec, int mid) override {
+            auto h = std::move(handler);
+            auto s = strand;
+            // freed before the completion, which may publish again
+            destroy();
+            mosquittoasio::post_completion(s, std::move(h), ec, mid);
+        }
+
+        void destroy() override {
+            auto& a = allocator;
+            this->~token_operation();
+            a.deallocate(this, sizeof(token_operation));
+        }
+
+        Handler handler;
+        strand_type strand;
+        handler_allocator& allocator;
+    };
+
+    // owns a publish operation, empty for the publishes nobody waits on
+    class publish_completion {
+       public:
+        publish_completion() = default;
+        explicit publish_completion(publish_operation* op) : op_(op) {}
+        publish_completion(publish_completion&& o) noexcept : op_(o.op_) {
+            o.op_ = nullptr;
+        }
+        publish_completion& operator=(publish_completion&& o) noexcept {
+            std::swap(op_, o.op_);
+            return *this;
+        }
+        ~publish_completion() {
+            if (op_) {
+                op_->destroy();
+            }
+        }
+
+        explicit operator bool() const { return op_ != nullptr; }
+
+        void complete(std::error_code ec, int mid) {
+            auto op = op_;
+            op_ = nullptr;
+            op->complete(ec, mid);
+        }
+        void post(std::error_code ec, int mid) {
+            auto op = op_;
+            op_ = nullptr;
+            op->post(ec, mid);
+        }
+
+       private:
+        publish_operation* op_{nullptr};
+    };
+
+    template <typename Operation, typename Handler>
+    publish_completion make_publish_completion(Handler&& handler) {
+        auto storage = allocator_->allocate(sizeof(Operation));
+        return publish_completion{new (storage) Operation{
+            std::forward<Handler>(handler), strand_, *allocator_}};
+    }
+
+    struct pending_publish {
+        std::string topic;
+        std::string payload;
+        int qos;
+        bool retain;
+        publish_completion handler;
+    };
+
+    struct inflight_publish {
+        int qos;
+        std::size_t bytes;
+        publish_completion handler;
+    };
+
+    void start_publish(std::string topic, std::string payload, int qos,
+                       publish_completion handler, bool retain);
+
+    // require the publish lock to be held
+    bool tracks_publishes() const {
+        return max_inflight_ || limits_.max_messages || limits_.max_bytes;
+    }
+    std::error_code enqueue_publish(pending_publish& p,
+                                    std::unique_lock<std::mutex>& lock);
+    bool outbound_fits(std::size_t bytes) const;
+    bool outbound_reached(unsigned percent) const;
+    void release_outbound(std::size_t bytes);
+    void issue_publish(pending_publish& p);
+    void issue_pending();
+
+    void post_completion(publish_completion& handler, std::error_code ec,
+                         int mid);
+
+    void on_publish(int mid);
+
+    message make_message(message::string_view topic,
+                         message::string_view payload, int qos, bool retain,
+                         int mid);
+    void queue_message(message msg);
+    void deliver_messages();
+
+    void on_message(message const& msg);
     void on_log(int level, std::string message);
 
     io_service& io_;
-    timer_type timer_;
+    strand_type strand_;
+    timer_type reconnect_timer_;
+    timer_type misc_timer_;
     socket_type socket_;
+    // shared with the handlers, which may be destroyed after the client
+    std::shared_ptr<handler_allocator> allocator_;
+
+    handle_type* native_handle_{nullptr};
+    std::unique_ptr<mqtt::transport> transport_;
+    std::unique_ptr<topic_table> topics_;
+    std::unique_ptr<buffer_pool> buffers_;
 
-    handle_type* native_handle_;
+    // messages read on the current batch, and the batch being delivered
+    std::vector<message> inbound_;
+    std::vector<message> delivering_;
+    metrics::clock::time_point inbound_since_;
+    std::size_t read_budget_{16};
+    // a read continuing a drain is dropped once the socket was released
+    unsigned socket_generation_{0};
+    // only touched from the strand
+    unsigned corked_{0};
 
-    bool connected_{false};
+    // async publishes, by message id, and the ones waiting for the window
+    std::mutex publish_mutex_;
+    std::unordered_map<int, inflight_publish> inflight_;
+    // unlike std::deque, allocates nothing until used
+    boost::container::deque<pending_publish> pending_;
+    std::size_t max_inflight_{0};
+    inflight_policy inflight_policy_{inflight_policy::queue};
+
+    // the outbound buffer, what is pending plus what is in flight
+    outbound_limits limits_;
+    std::size_t outbound_messages_{0};
+    std::size_t outbound_bytes_{0};
+    bool above_high_watermark_{false};
+    std::condition_variable outbound_space_;
+    // lets the native callback skip posting when nothing awaits completion
+    std::atomic<std::size_t> async_publishes_{0};
+
+    std::atomic<bool> connected_{false};
+    // the async_connect calls waiting for the connection, only touched from
+    // the strand
+    std::vector<std::function<void(std::error_code)>> connect_waiters_;
     bool writting_{false};
+
+    int keep_alive_{0};
+    metrics::clock::time_point last_read_;
+    // also set by publishes from any thread
+    std::atomic<metrics::clock::time_point> last_write_;
+
+    reconnect_policy reconnect_policy_;
+    // attempts since the last stable connection failed
+    unsigned reconnect_attempts_{0};
+    // when the current connection was established, default while not
+    // connected
+    metrics::clock::time_point connected_since_{};
+    bool reconnect_scheduled_{false};
+    metrics::clock::time_point failed_since_;
+    std::minstd_rand random_;
+
+    client_metrics metrics_;
+};
+
+template <typename CompletionToken>
+auto client::async_connect(std::string host, int port, int keep_alive,
+                           CompletionToken&& token)
+    -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(std::error_code)) {
+    return boost::asio::async_initiate<CompletionToken, void(std::error_code)>(
+        initiate_connect{this}, token, std::move(host), port, keep_alive);
+}
+
+template <typename CompletionToken>
+auto client::async_publish(std::string topic, std::string payload, int qos,
+                           CompletionToken&& token, bool retain) ->
+    typename std::enable_if<
+        !is_publish_handler<CompletionToken>::value,
+        BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken,
+                                      void(std::error_code, int))>::type {
+    return boost::asio::async_initiate<CompletionToken,
+                                       void(std::error_code, int)>(
+        initiate_publish{this}, token, std::move(topic), std::move(payload),
+        qos, retain);
+}
+
+template <typename Handler>
+void client::initiate_connect::operator()(Handler&& handler, std::string host,
+                                          int port, int keep_alive) const {
+    // std::function requires a copyable handler
+    auto h = std::make_shared<typename std::decay<Handler>::type>(
+        std::forward<Handler>(handler));
+    auto c = self;
+    // registered before connecting, the strand runs both in order
+    self->strand_.dispatch(self->bind_allocator([c, h] {
+        auto strand = c->strand_;
+        c->connect_waiters_.emplace_back([h, strand](std::error_code ec) {
+            mosquittoasio::post_completion(strand, std::move(*h), ec);
+        });
+    }));
+    self->connect(host.c_str(), port, keep_alive);
+}
+
+template <typename Handler>
+void client::initiate_publish::operator()(Handler&& handler, std::string topic,
+                                          std::string payload, int qos,
+                                          bool retain) const {
+    using operation_type = token_operation<typename std::decay<Handler>::type>;
+    self->start_publish(
+        std::move(topic), std::move(payload), qos,
+        self->make_publish_completion<operation_type>(
+            std::forward<Handler>(handler)),
+        retain);
+}
+
+// corks the client for its lifetime
+class publish_batch {
+   public:
+    explicit publish_batch(client& c) : client_(c) { client_.cork(); }
+    ~publish_batch() { client_.uncork(); }
+
+    publish_batch(publish_batch const&) = delete;
+    publish_batch& operator=(publish_batch const&) = delete;
+
+   private:
+    client& client_;
 };
+
 }  // namespace mosquittoasio
@@ -0,0 +1,77 @@
+#include "client_pool.hpp"
+
+#include "error.hpp"
+
+#include <boost/functional/hash.hpp>
+
+#include <algorithm>
+
+namespace mosquittoasio {
+
+client_pool::client_pool(io_service& io, std::size_t size,
+                         char const* client_id, bool clean_session)
+    : strand_(io) {
+    if (!size) {
+        throw std::system_error{make_error_code(errc::invalid_parameters)};
+    }
+    clients_.reserve(size);
+    dispatchers_.reserve(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        std::unique_ptr<client> c;
+        if (client_id) {
+            auto id = std::string(client_id) + '-' + std::to_string(i);
+            c.reset(new client{io, id.c_str(), clean_session});
+        } else {
+            c.reset(new client{io, nullptr, clean_session});
+        }
+
+        // the clients run on strands of their own, the emissions are
+        // serialized on the pool strand
+        auto on_state_changed = [this] {
+            strand_.post([this] { state_changed_signal(connected_count()); });
+        };
+        connections_.emplace_back(c->connected_signal.connect(on_state_changed));
+        connections_.emplace_back(
+            c->disconnected_signal.connect(on_state_changed));
+
+        dispatchers_.emplace_back(new dispatcher{*c});
+        clients_.push_back(std::move(c));
+    }
+}
+
+void client_pool::set_tls(char const* capath) {
+    for (auto& c : clients_) {
+        c->set_tls(capath);
+    }
+}
+
+void client_pool::connect(char const* host, int port, int keep_alive) {
+    for (auto& c : clients_) {
+        c->connect(host, port, keep_alive);
+    }
+}
+
+std::size_t client_pool::connected_count() const {
+    return std::count_if(
+        clients_.begin(), clients_.end(),
+        [](std::unique_ptr<client> const& c) { return c->is_connected(); });
+}
+
+void client_pool::publish(char const* topic, std::string const& payload,
+                          int qos, bool retain) {
+    client_for(topic).publish(topic, payload, qos, retain);
+}
+
+client& client_pool::client_for(boost::string_view topic) {
+    return *clients_[index_for(topic)];
+}
+
+dispatcher& client_pool::dispatcher_for(boost::string_view topic) {
+    return *dispatchers_[index_for(topic)];
+}
+
+std::size_t client_pool::index_for(boost::string_view topic) const {
+    return boost::hash_range(topic.begin(), topic.end()) % clients_.size();
+}
+
+}  // namespace mosquittoasio
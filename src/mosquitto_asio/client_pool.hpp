@@ -0,0 +1,69 @@
+#pragma once
+
+#include "client.hpp"
+#include "dispatcher.hpp"
+#include "signal.hpp"
+
+#include <boost/utility/string_view.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace mosquittoasio {
+
+// Owns several clients connected to the same broker, each one with its own
+// dispatcher, and routes publishes and subscriptions by topic hash so the
+// messages of a topic keep their order through a single connection
+class client_pool {
+   public:
+    using io_service = client::io_service;
+    using strand_type = client::strand_type;
+    using state_changed_signal_type =
+        signal<void(std::size_t connected_count)>;
+
+    // client ids are the given id followed by "-<index>", a null id lets
+    // mosquitto generate them; throws invalid_parameters for an empty pool
+    client_pool(io_service& io, std::size_t size,
+                char const* client_id = nullptr, bool clean_session = true);
+
+    client_pool(client_pool const&) = delete;
+    client_pool& operator=(client_pool const&) = delete;
+
+    void set_tls(char const* capath);
+    void connect(char const* host, int port, int keep_alive);
+
+    std::size_t size() const { return clients_.size(); }
+    std::size_t connected_count() const;
+    bool is_connected() const { return connected_count() == size(); }
+
+    void publish(char const* topic, std::string const& payload, int qos,
+                 bool retain = false);
+
+    template <typename Handler>
+    subscription subscribe(std::string topic, int qos, Handler&& h);
+
+    client& client_at(std::size_t index) { return *clients_[index]; }
+    client& client_for(boost::string_view topic);
+    dispatcher& dispatcher_for(boost::string_view topic);
+
+    // emitted from the strand of the pool, never concurrently, once a
+    // client connected or disconnected
+    state_changed_signal_type state_changed_signal;
+    strand_type& strand() { return strand_; }
+
+   private:
+    std::size_t index_for(boost::string_view topic) const;
+
+    strand_type strand_;
+    std::vector<std::unique_ptr<client>> clients_;
+    std::vector<std::unique_ptr<dispatcher>> dispatchers_;
+    std::vector<scoped_connection> connections_;
+};
+
+template <typename Handler>
+subscription client_pool::subscribe(std::string topic, int qos, Handler&& h) {
+    auto& d = dispatcher_for(topic);
+    return d.subscribe(std::move(topic), qos, std::forward<Handler>(h));
+}
+
+}  // namespace mosquittoasio
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <boost/asio.hpp>
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace mosquittoasio {
+namespace detail {
+
+template <std::size_t... I>
+struct indices {};
+
+template <std::size_t N, std::size_t... I>
+struct make_indices : make_indices<N - 1, N - 1, I...> {};
+
+template <std::size_t... I>
+struct make_indices<0, I...> {
+    using type = indices<I...>;
+};
+
+// a completion handler along with its arguments
+template <typename Handler, typename... Args>
+class bound_completion {
+   public:
+    explicit bound_completion(Handler handler, Args... args)
+        : handler_(std::move(handler)), args_(std::move(args)...) {}
+
+    void operator()() {
+        call(typename make_indices<sizeof...(Args)>::type{});
+    }
+
+   private:
+    template <std::size_t... I>
+    void call(indices<I...>) {
+        handler_(std::move(std::get<I>(args_))...);
+    }
+
+    Handler handler_;
+    std::tuple<Args...> args_;
+};
+
+}  // namespace detail
+
+// Completes an operation started with a completion token: the handler is
+// called with the arguments through its associated executor, or through
+// fallback, never from inside the caller
+template <typename Executor, typename Handler, typename... Args>
+void post_completion(Executor const& fallback, Handler&& handler,
+                     Args&&... args) {
+    using completion_type =
+        detail::bound_completion<typename std::decay<Handler>::type,
+                                 typename std::decay<Args>::type...>;
+    auto executor = boost::asio::get_associated_executor(handler, fallback);
+    boost::asio::post(executor,
+                      completion_type{std::forward<Handler>(handler),
+                                      std::forward<Args>(args)...});
+}
+
+}  // namespace mosquittoasio
@@ -0,0 +1,113 @@
+#pragma once
+
+// C++20 coroutine forms of the asynchronous operations. The library builds
+// as C++11, only the sources including this header need C++20.
+// Without a wrapper, co_await with use_awaitable returns the error instead
+// of throwing: a std::error_code from async_connect, and a
+// std::tuple<std::error_code, T> from async_publish and async_receive.
+
+// boost 1.74 awaitable.hpp uses std::exchange without including it
+#include <utility>
+
+#include <boost/asio.hpp>
+
+#if !defined(BOOST_ASIO_HAS_CO_AWAIT)
+#error "coroutine.hpp requires C++20 coroutines"
+#endif
+
+#include "client.hpp"
+#include "message.hpp"
+#include "receiver.hpp"
+
+#include <exception>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+namespace mosquittoasio {
+namespace coro {
+
+template <typename T>
+using awaitable = boost::asio::awaitable<T>;
+
+namespace detail {
+
+// completes with an exception instead of an error code, so use_awaitable
+// throws it with no coroutine of ours in between
+template <typename Handler>
+struct throwing_handler {
+    template <typename... Args>
+    void operator()(std::error_code ec, Args&&... args) {
+        handler(ec ? std::make_exception_ptr(std::system_error{ec}) : nullptr,
+                std::forward<Args>(args)...);
+    }
+
+    Handler handler;
+};
+
+template <typename Handler>
+throwing_handler<std::decay_t<Handler>> make_throwing(Handler&& handler) {
+    return {std::forward<Handler>(handler)};
+}
+
+}  // namespace detail
+
+// these throw std::system_error on failure. Each await takes one coroutine
+// frame, which asio recycles per thread, so a loop awaiting them one after
+// the other allocates no frame once warm
+
+inline awaitable<void> connect(client& c, std::string host, int port,
+                               int keep_alive) {
+    return boost::asio::async_initiate<boost::asio::use_awaitable_t<> const,
+                                       void(std::exception_ptr)>(
+        [&c, port, keep_alive](auto handler, std::string host) {
+            c.async_connect(std::move(host), port, keep_alive,
+                            detail::make_throwing(std::move(handler)));
+        },
+        boost::asio::use_awaitable, std::move(host));
+}
+
+// the message id
+inline awaitable<int> publish(client& c, std::string topic,
+                              std::string payload, int qos,
+                              bool retain = false) {
+    return boost::asio::async_initiate<boost::asio::use_awaitable_t<> const,
+                                       void(std::exception_ptr, int)>(
+        [&c, qos, retain](auto handler, std::string topic,
+                          std::string payload) {
+            c.async_publish(std::move(topic), std::move(payload), qos,
+                            detail::make_throwing(std::move(handler)), retain);
+        },
+        boost::asio::use_awaitable, std::move(topic), std::move(payload));
+}
+
+inline awaitable<message> receive(receiver& r) {
+    return boost::asio::async_initiate<boost::asio::use_awaitable_t<> const,
+                                       void(std::exception_ptr, message)>(
+        [&r](auto handler) {
+            r.async_receive(detail::make_throwing(std::move(handler)));
+        },
+        boost::asio::use_awaitable);
+}
+
+}  // namespace coro
+}  // namespace mosquittoasio
+
+namespace boost {
+namespace asio {
+
+// resumes the coroutine on its own executor
+template <typename Handler, typename Executor>
+struct associated_executor<
+    mosquittoasio::coro::detail::throwing_handler<Handler>, Executor> {
+    using type = typename associated_executor<Handler, Executor>::type;
+
+    static type get(
+        mosquittoasio::coro::detail::throwing_handler<Handler> const& h,
+        Executor const& ex = Executor()) noexcept {
+        return associated_executor<Handler, Executor>::get(h.handler, ex);
+    }
+};
+
+}  // namespace asio
+}  // namespace boost
@@ -12,23 +12,49 @@ dispatcher::dispatcher(client& c)
               on_connect();
           })),
       message_received_connection(client_.message_received_signal.connect(
-          [this](std::string const& topic, std::string const& payload) {
-              on_message(topic, payload);
+          [this](message const& msg) {
+              on_message(msg);
           })) {
 }
 
+receiver dispatcher::receive(std::string topic, int qos,
+                             std::size_t capacity) {
+    auto s = std::make_shared<receiver::state>(client_.strand(), capacity);
+    auto sub = subscribe(std::move(topic), qos,
+                         [s](message const& msg) { s->push(msg); });
+    return receiver{std::move(s), std::move(sub)};
+}
+
 void dispatcher::unsubscribe(std::string const& topic) {
     // XXX: erasing on a separate work to guarantee not beeing nested from a
     // on_message callback, the function can deal with any other callback
     // subscribes or unsubscribes beetween now and the work with no problem
-    client_.io().post([this, topic] { erase_entry(topic); });
+    client_.strand().post(
+        client_.bind_allocator([this, topic] { erase_entry(topic); }));
+}
+
+void dispatcher::set_match_cache_size(std::size_t topics) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    cache_.reset(topics);
+}
+
+std::uint64_t dispatcher::match_cache_hits() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return cache_.hits();
+}
+
+std::uint64_t dispatcher::match_cache_misses() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return cache_.misses();
 }
 
 auto dispatcher::emplace_entry(std::string topic, int qos) -> entry& {
     auto it = entries_.find(topic);
-    bool updated;
+    bool updated = false;
     if (it == entries_.end()) {
         std::tie(it, updated) = entries_.emplace(topic, entry{topic, qos, {}});
+        index_.insert(it->second.topic, &it->second);
+        cache_.invalidate_filter(it->second.topic);
     }
 
     auto& entry = it->second;
@@ -47,6 +73,7 @@ auto dispatcher::emplace_entry(std::string topic, int qos) -> entry& {
 }
 
 void dispatcher::erase_entry(std::string const& topic) {
+    std::lock_guard<std::mutex> lock{mutex_};
     auto it = entries_.find(topic);
     if (it == entries_.end()) {
         return;
@@ -54,12 +81,18 @@ void dispatcher::erase_entry(std::string const& topic) {
 
     auto const& entry = it->second;
     if (entry.signal.empty()) {
-        client_.send_unsubscribe(topic);
-        entries_.erase(topic);
+        // the subscriptions are sent again on connection
+        if (client_.is_connected()) {
+            client_.send_unsubscribe(topic);
+        }
+        cache_.invalidate_value(&it->second.signal);
+        index_.erase(topic);
+        entries_.erase(it);
     }
 }
 
 void dispatcher::on_connect() {
+    std::lock_guard<std::mutex> lock{mutex_};
     using element_type = std::pair<std::string, entry const&>;
     std::for_each(entries_.begin(), entries_.end(), [this](element_type e) {
         auto& entry = e.second;
@@ -67,24 +100,45 @@ void dispatcher::on_connect() {
     });
 }
 
-void dispatcher::on_message(std::string const& topic,
-                            std::string const& payload) {
-    LOG_INFO(<< "dispatcher::on_message; topic:\"" << topic
-             << "\" payload:\"" << payload << '\"');
+void dispatcher::on_message(message const& msg) {
+    LOG_VERBOSE(<< "dispatcher::on_message; topic:\"" << msg.topic()
+                << "\" payload size:" << msg.payload().size());
+
+    // entries are only erased on the strand, so the matched signals stay
+    // valid after releasing the lock; handlers may subscribe again
+    auto first = matched_.size();
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        // an interned topic is found by its id without hashing it again
+        auto cached = cache_.find(msg.topic(), msg.id());
+        if (cached) {
+            matched_.insert(matched_.end(), cached->begin(), cached->end());
+        } else {
+            index_.match(msg.topic(), [this](entry* e) {
+                matched_.push_back(&e->signal);
+            });
+            if (cache_.capacity()) {
+                cache_.insert(msg.topic(),
+                              {matched_.begin() + first, matched_.end()},
+                              msg.id());
+            }
+        }
+    }
 
-    using element_type = std::pair<std::string, entry const&>;
-    std::for_each(entries_.cbegin(), entries_.cend(),
-                  [this, &topic, &payload](element_type e) {
-                      auto& entry = e.second;
-                      auto matches = native::topic_matches_subscription(
-                          entry.topic.c_str(), topic.c_str());
-
-                      if (!matches) {
-                          return;
-                      }
-
-                      entry.signal(topic, payload);
-                  });
+    auto last = matched_.size();
+    metrics_.messages.add();
+    metrics_.matches.add(last - first);
+    metrics_.fan_out.record(last - first);
+    if (first == last) {
+        metrics_.unmatched.add();
+    }
+
+    auto start = metrics::clock::now();
+    for (auto i = first; i < last; ++i) {
+        (*matched_[i])(msg);
+    }
+    metrics_.handler_latency_ns.record(metrics::elapsed_ns(start));
+    matched_.resize(first);
 }
 
 }  // namespace mosquittoasio
@@ -1,15 +1,30 @@
 #pragma once
 
+#include "error.hpp"
+#include "match_cache.hpp"
+#include "message.hpp"
+#include "metrics.hpp"
+#include "offload_executor.hpp"
+#include "receiver.hpp"
+#include "signal.hpp"
 #include "subscription.hpp"
-
-#include <boost/signals2.hpp>
-
+#include "topic_tree.hpp"
+
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 namespace mosquittoasio {
 
 class client;
 
+// Entries may be subscribed from any thread, messages are dispatched and
+// entries erased on the client strand; handlers run without the lock held
 class dispatcher {
    public:
     dispatcher(client&);
@@ -17,18 +32,54 @@ class dispatcher {
     dispatcher(dispatcher const&) = delete;
     dispatcher& operator=(dispatcher const&) = delete;
 
-    dispatcher(dispatcher&&) = default;
-    dispatcher& operator=(dispatcher&&) = default;
+    dispatcher(dispatcher&&) = delete;
+    dispatcher& operator=(dispatcher&&) = delete;
+
+    template <typename Handler>
+    subscription subscribe(std::string topic, int qos, Handler&& h);
 
+    // runs the handler on the executor instead of the client strand, with a
+    // copy of the message; the handlers of the messages sharing a key run
+    // in order, the default key being the topic. Messages dropped by a full
+    // executor are not handled
     template <typename Handler>
+    subscription subscribe(std::string topic, int qos, Handler&& h,
+                           offload_executor& executor,
+                           offload_executor::key_function key = {});
+
+    // decodes the payloads for the subscriptions of type T, taking the
+    // message and returning a T or throwing on failure
+    template <typename T>
+    void set_decoder(std::function<T(message const&)> decoder);
+
+    // the handler is called with the message and its payload decoded as a
+    // T by the decoder set for T when subscribing, once per message and
+    // decoder whatever the number of subscriptions matching it; messages failing to decode are not
+    // handled, decode_failed_signal reports them once. Throws
+    // invalid_parameters when no decoder is set for T
+    template <typename T, typename Handler>
     subscription subscribe(std::string topic, int qos, Handler&& h);
 
+    // queues the messages of the topic for a consumer pulling them with
+    // receiver::async_receive, up to capacity of them
+    receiver receive(std::string topic, int qos, std::size_t capacity = 64);
+
     void unsubscribe(std::string const& topic);
 
+    // bounds the concrete topics whose matching entries are cached, so
+    // repeated topics are dispatched with a single lookup; zero disables it
+    void set_match_cache_size(std::size_t topics);
+    std::uint64_t match_cache_hits() const;
+    std::uint64_t match_cache_misses() const;
+
+    dispatcher_metrics const& metrics() const { return metrics_; }
+
+    // a message whose payload failed to decode, with the failure
+    lazy_signal<void(message const&, std::exception_ptr)> decode_failed_signal;
+
    private:
-    using callback_type = void(std::string const& topic,
-                               std::string const& payload);
-    using signal_type = boost::signals2::signal<callback_type>;
+    using callback_type = void(message const&);
+    using signal_type = signal<callback_type>;
 
     struct entry {
         std::string topic;
@@ -36,25 +87,117 @@ class dispatcher {
         signal_type signal;
     };
 
+    // requires the lock to be held
     entry& emplace_entry(std::string topic, int qos);
     void erase_entry(std::string const& topic);
 
     void on_connect();
-    void on_message(std::string const& topic, std::string const& payload);
+    void on_message(message const& msg);
+
+    template <typename T>
+    T decode(std::function<T(message const&)> const& decoder,
+             message const& msg);
 
     client& client_;
 
-    boost::signals2::scoped_connection connected_connection;
-    boost::signals2::scoped_connection message_received_connection;
+    scoped_connection connected_connection;
+    scoped_connection message_received_connection;
 
+    mutable std::mutex mutex_;
     std::unordered_map<std::string, entry> entries_;
+    // std::function<T(message const&)> by type_key<T>
+    std::unordered_map<void const*, std::shared_ptr<void const>> decoders_;
+    topic_tree<entry*> index_;
+    match_cache<signal_type*> cache_{1024};
+
+    // signals matched by the current message, only used on the strand
+    std::vector<signal_type*> matched_;
+
+    dispatcher_metrics metrics_;
 };
 
 template <typename Handler>
 subscription dispatcher::subscribe(std::string topic, int qos, Handler&& h) {
+    std::lock_guard<std::mutex> lock{mutex_};
     auto& entry = emplace_entry(topic, qos);
     return subscription{*this, entry.topic,
                         entry.signal.connect(std::forward<Handler>(h))};
 }
 
+template <typename Handler>
+subscription dispatcher::subscribe(std::string topic, int qos, Handler&& h,
+                                   offload_executor& executor,
+                                   offload_executor::key_function key) {
+    using handler_type = typename std::decay<Handler>::type;
+    auto handler = std::make_shared<handler_type>(std::forward<Handler>(h));
+    if (!key) {
+        key = offload_executor::topic_key;
+    }
+    // the handler is shared with the queued messages, which may run after
+    // the subscription ended
+    return subscribe(std::move(topic), qos,
+                     [&executor, handler, key](message const& msg) {
+                         executor.post(key(msg),
+                                       [handler, msg] { (*handler)(msg); });
+                     });
+}
+
+template <typename T>
+void dispatcher::set_decoder(std::function<T(message const&)> decoder) {
+    using decoder_type = std::function<T(message const&)>;
+    std::lock_guard<std::mutex> lock{mutex_};
+    decoders_[type_key<T>()] =
+        std::make_shared<decoder_type const>(std::move(decoder));
+}
+
+template <typename T, typename Handler>
+subscription dispatcher::subscribe(std::string topic, int qos, Handler&& h) {
+    using decoder_type = std::function<T(message const&)>;
+    std::shared_ptr<decoder_type const> decoder;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = decoders_.find(type_key<T>());
+        if (it != decoders_.end()) {
+            decoder = std::static_pointer_cast<decoder_type const>(it->second);
+        }
+    }
+    if (!decoder) {
+        throw std::system_error{make_error_code(errc::invalid_parameters)};
+    }
+
+    auto handler = typename std::decay<Handler>::type(std::forward<Handler>(h));
+    return subscribe(
+        std::move(topic), qos,
+        [this, decoder, handler](message const& msg) mutable {
+            std::shared_ptr<T const> value;
+            try {
+                // keyed by the decoder, which the subscription keeps alive,
+                // so subscriptions made before and after set_decoder
+                // replaced it get their own value
+                value = msg.decode<T>(
+                    [this, &decoder](message const& m) {
+                        return decode(*decoder, m);
+                    },
+                    decoder.get());
+            } catch (...) {
+                // already reported by the call that decoded
+                return;
+            }
+            handler(msg, *value);
+        });
+}
+
+template <typename T>
+T dispatcher::decode(std::function<T(message const&)> const& decoder,
+                     message const& msg) {
+    metrics_.decodes.add();
+    try {
+        return decoder(msg);
+    } catch (...) {
+        metrics_.decode_failures.add();
+        decode_failed_signal(msg, std::current_exception());
+        throw;
+    }
+}
+
 }  // namespace mosquittoasio
@@ -0,0 +1,63 @@
+#include "handler_allocator.hpp"
+
+#include <new>
+
+namespace mosquittoasio {
+namespace {
+
+// index of the smallest class holding size bytes, classes when too large
+std::size_t size_class(std::size_t size) {
+    std::size_t index = 0;
+    while (index < handler_allocator::classes &&
+           (handler_allocator::min_size << index) < size) {
+        ++index;
+    }
+    return index;
+}
+
+}  // namespace
+
+handler_allocator::~handler_allocator() {
+    for (auto head : free_) {
+        while (auto b = head) {
+            head = b->next;
+            ::operator delete(b);
+        }
+    }
+}
+
+void* handler_allocator::allocate(std::size_t size) {
+    auto index = size_class(size);
+    if (index == classes) {
+        allocations_.add();
+        return ::operator new(size);
+    }
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (auto b = free_[index]) {
+            free_[index] = b->next;
+            --cached_[index];
+            reuses_.add();
+            return b;
+        }
+    }
+    allocations_.add();
+    return ::operator new(min_size << index);
+}
+
+void handler_allocator::deallocate(void* p, std::size_t size) {
+    auto index = size_class(size);
+    if (index < classes) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (cached_[index] < max_cached) {
+            auto b = static_cast<block*>(p);
+            b->next = free_[index];
+            free_[index] = b;
+            ++cached_[index];
+            return;
+        }
+    }
+    ::operator delete(p);
+}
+
+}  // namespace mosquittoasio
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "metrics.hpp"
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+namespace mosquittoasio {
+
+// Recycles the storage asio allocates for the handlers of one owner: freed
+// blocks are kept on a free list by power of two size class, from 64 to
+// 512 bytes, up to max_cached blocks each, so an owner posting and waiting
+// at a steady rate reuses the same few blocks. Larger blocks come from the
+// heap every time. Thread safe, handlers may be allocated and freed on any
+// thread.
+class handler_allocator {
+   public:
+    static constexpr std::size_t min_size = 64;
+    static constexpr std::size_t classes = 4;
+    static constexpr std::size_t max_cached = 16;
+
+    handler_allocator() = default;
+    ~handler_allocator();
+
+    handler_allocator(handler_allocator const&) = delete;
+    handler_allocator& operator=(handler_allocator const&) = delete;
+
+    void* allocate(std::size_t size);
+    void deallocate(void* p, std::size_t size);
+
+    // blocks allocated from the heap and blocks reused
+    std::uint64_t heap_allocations() const { return allocations_.value(); }
+    std::uint64_t reuses() const { return reuses_.value(); }
+
+   private:
+    struct block {
+        block* next;
+    };
+
+    std::mutex mutex_;
+    std::array<block*, classes> free_{};
+    std::array<std::size_t, classes> cached_{};
+    metrics::counter allocations_;
+    metrics::counter reuses_;
+};
+
+// A handler taking its asio storage from a handler_allocator, which it
+// keeps alive so it may be destroyed after its owner
+template <typename Handler>
+class allocating_handler {
+   public:
+    allocating_handler(std::shared_ptr<handler_allocator> allocator,
+                       Handler handler)
+        : allocator_(std::move(allocator)), handler_(std::move(handler)) {}
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        handler_(std::forward<Args>(args)...);
+    }
+
+    friend void* asio_handler_allocate(std::size_t size,
+                                       allocating_handler* h) {
+        return h->allocator_->allocate(size);
+    }
+
+    friend void asio_handler_deallocate(void* p, std::size_t size,
+                                        allocating_handler* h) {
+        h->allocator_->deallocate(p, size);
+    }
+
+   private:
+    std::shared_ptr<handler_allocator> allocator_;
+    Handler handler_;
+};
+
+template <typename Handler>
+allocating_handler<typename std::decay<Handler>::type>
+make_allocating_handler(std::shared_ptr<handler_allocator> const& allocator,
+                        Handler&& handler) {
+    return {allocator, std::forward<Handler>(handler)};
+}
+
+}  // namespace mosquittoasio
@@ -0,0 +1,218 @@
+#include "log.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace mosquittoasio {
+namespace log {
+
+namespace detail {
+std::atomic<int> current_level{static_cast<int>(level::info)};
+}  // namespace detail
+
+namespace {
+
+constexpr std::size_t max_line = 256;
+
+struct style {
+    char const* tag;
+    char const* color;
+};
+
+style const styles[] = {
+    {"TRC", "35"}, {"VRB", "37"}, {"DBG", "34"}, {"INF", "32"},
+    {"NOT", "33"}, {"WRN", "33"}, {"ERR", "31"}, {"", "0"},
+};
+
+void format(std::string& out, level l, char const* text, std::size_t size) {
+    auto const& s = styles[static_cast<int>(l)];
+    out += "\033[";
+    out += s.color;
+    out += 'm';
+    out += s.tag;
+    out += " - ";
+    out.append(text, size);
+    out += "\033[0m\n";
+}
+
+// bounded multi producer queue of fixed size lines, each cell sequence
+// tells whether it is free for the producer at that position or holds a
+// line for the consumer (Vyukov's bounded queue)
+class ring {
+   public:
+    explicit ring(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        mask_ = size - 1;
+        cells_.reset(new cell[size]);
+        for (std::size_t i = 0; i < size; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool push(level l, std::string const& line) {
+        auto pos = push_pos_.load(std::memory_order_relaxed);
+        cell* c;
+        while (true) {
+            c = &cells_[pos & mask_];
+            auto seq = c->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) -
+                        static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (push_pos_.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = push_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        c->lvl = l;
+        c->size = std::min(line.size(), max_line);
+        std::memcpy(c->text, line.data(), c->size);
+        c->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // single consumer
+    bool pop(std::string& out) {
+        auto& c = cells_[pop_pos_ & mask_];
+        auto seq = c.sequence.load(std::memory_order_acquire);
+        if (seq != pop_pos_ + 1) {
+            return false;
+        }
+        format(out, c.lvl, c.text, c.size);
+        c.sequence.store(pop_pos_ + mask_ + 1, std::memory_order_release);
+        ++pop_pos_;
+        return true;
+    }
+
+   private:
+    struct cell {
+        std::atomic<std::size_t> sequence;
+        level lvl;
+        std::size_t size;
+        char text[max_line];
+    };
+
+    std::unique_ptr<cell[]> cells_;
+    std::size_t mask_;
+    std::atomic<std::size_t> push_pos_{0};
+    std::size_t pop_pos_{0};
+};
+
+class async_sink {
+   public:
+    explicit async_sink(std::size_t capacity)
+        : ring_(capacity), thread_([this] { run(); }) {}
+
+    ~async_sink() {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            running_ = false;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    void push(level l, std::string const& line) {
+        if (!ring_.push(l, line)) {
+            ++dropped_;
+            return;
+        }
+        // only the line finding the ring empty wakes the writer, under the
+        // lock so the wake up is not lost
+        if (queued_.fetch_add(1) == 0) {
+            std::lock_guard<std::mutex> lock{mutex_};
+            wake_.notify_one();
+        }
+    }
+
+    std::uint64_t dropped() const { return dropped_; }
+
+   private:
+    void run() {
+        std::string out;
+        while (true) {
+            long popped = 0;
+            while (ring_.pop(out)) {
+                ++popped;
+            }
+            if (popped) {
+                queued_ -= popped;
+                std::cout.write(out.data(), out.size());
+                std::cout.flush();
+                out.clear();
+                continue;
+            }
+            // sleeps until a line is queued, what was queued before
+            // stopping is still written
+            std::unique_lock<std::mutex> lock{mutex_};
+            if (!running_) {
+                break;
+            }
+            wake_.wait(lock, [this] { return queued_ > 0 || !running_; });
+        }
+    }
+
+    ring ring_;
+    // lines pushed and not popped yet, negative while the writer pops a
+    // line before its producer counted it
+    std::atomic<long> queued_{0};
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool running_{true};
+    std::atomic<std::uint64_t> dropped_{0};
+    std::thread thread_;
+};
+
+std::unique_ptr<async_sink> sink;
+std::atomic<async_sink*> active_sink{nullptr};
+std::atomic<std::uint64_t> dropped_lines{0};
+
+}  // namespace
+
+void write(level l, std::string const& line) {
+    auto s = active_sink.load(std::memory_order_acquire);
+    if (s) {
+        s->push(l, line);
+        return;
+    }
+    std::string out;
+    format(out, l, line.data(), line.size());
+    std::cout.write(out.data(), out.size());
+}
+
+void start_async(std::size_t capacity) {
+    stop_async();
+    sink.reset(new async_sink{capacity});
+    active_sink.store(sink.get(), std::memory_order_release);
+}
+
+void stop_async() {
+    if (!sink) {
+        return;
+    }
+    active_sink.store(nullptr, std::memory_order_release);
+    dropped_lines += sink->dropped();
+    sink.reset();
+}
+
+std::uint64_t dropped() {
+    auto s = active_sink.load(std::memory_order_acquire);
+    return dropped_lines + (s ? s->dropped() : 0);
+}
+
+}  // namespace log
+}  // namespace mosquittoasio
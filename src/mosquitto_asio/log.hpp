@@ -1,24 +1,130 @@
 #pragma once
 
 #include <boost/current_function.hpp>
+
+#include <atomic>
+#include <cstdint>
 #include <iomanip>
-#include <iostream>
 #include <sstream>
+#include <string>
+
+// numeric log levels, usable by the preprocessor
+#define MOSQUITTOASIO_LOG_LEVEL_TRACE 0
+#define MOSQUITTOASIO_LOG_LEVEL_VERBOSE 1
+#define MOSQUITTOASIO_LOG_LEVEL_DEBUG 2
+#define MOSQUITTOASIO_LOG_LEVEL_INFO 3
+#define MOSQUITTOASIO_LOG_LEVEL_NOTICE 4
+#define MOSQUITTOASIO_LOG_LEVEL_WARNING 5
+#define MOSQUITTOASIO_LOG_LEVEL_ERROR 6
+#define MOSQUITTOASIO_LOG_LEVEL_NONE 7
+
+// statements below this level are not compiled at all
+#ifndef MOSQUITTOASIO_LOG_LEVEL
+#define MOSQUITTOASIO_LOG_LEVEL MOSQUITTOASIO_LOG_LEVEL_TRACE
+#endif
+
+namespace mosquittoasio {
+namespace log {
+
+enum class level : int {
+    trace = MOSQUITTOASIO_LOG_LEVEL_TRACE,
+    verbose = MOSQUITTOASIO_LOG_LEVEL_VERBOSE,
+    debug = MOSQUITTOASIO_LOG_LEVEL_DEBUG,
+    info = MOSQUITTOASIO_LOG_LEVEL_INFO,
+    notice = MOSQUITTOASIO_LOG_LEVEL_NOTICE,
+    warning = MOSQUITTOASIO_LOG_LEVEL_WARNING,
+    error = MOSQUITTOASIO_LOG_LEVEL_ERROR,
+    none = MOSQUITTOASIO_LOG_LEVEL_NONE,
+};
+
+namespace detail {
+extern std::atomic<int> current_level;
+}  // namespace detail
+
+// statements below the runtime level are skipped before being formatted
+inline bool enabled(level l) {
+    return static_cast<int>(l) >=
+           detail::current_level.load(std::memory_order_relaxed);
+}
+inline void set_level(level l) {
+    detail::current_level.store(static_cast<int>(l),
+                                std::memory_order_relaxed);
+}
+inline level get_level() {
+    return static_cast<level>(
+        detail::current_level.load(std::memory_order_relaxed));
+}
+
+// writes a line to stdout, or queues it when the asynchronous sink runs
+void write(level l, std::string const& line);
+
+// from now on lines are queued on a lock free ring of capacity lines,
+// truncated to 256 characters, and written by a background thread
+// sleeping while the ring is empty; lines finding the ring full are
+// dropped. Neither call may race with logging
+// from other threads.
+void start_async(std::size_t capacity = 4096);
+// writes what is queued and joins the background thread
+void stop_async();
+// lines dropped by the asynchronous sink so far
+std::uint64_t dropped();
 
-#define LOG_PRINT(tag__, color__, msg__)                    \
-    do {                                                    \
-        std::stringstream stringstream__;                   \
-        (stringstream__ msg__);                             \
-        std::cout << "\033[" << color__ << "m"              \
-                  << tag__ << " - " << stringstream__.str() \
-                  << "\033[0m" << '\n';                     \
+}  // namespace log
+}  // namespace mosquittoasio
+
+#define LOG_PRINT(level__, msg__)                                     \
+    do {                                                              \
+        if (::mosquittoasio::log::enabled(level__)) {                 \
+            std::ostringstream stringstream__;                        \
+            (stringstream__ msg__);                                   \
+            ::mosquittoasio::log::write(level__, stringstream__.str()); \
+        }                                                             \
+    } while (0)
+
+#define LOG_DISABLED() \
+    do {               \
     } while (0)
 
-#define LOG_ERROR(msg) LOG_PRINT("ERR", "31", msg)
-#define LOG_WARNING(msg) LOG_PRINT("WRN", "33", msg)
-#define LOG_NOTICE(msg) LOG_PRINT("NOT", "33", msg)
-#define LOG_INFO(msg) LOG_PRINT("INF", "32", msg)
-#define LOG_DEBUG(msg) LOG_PRINT("DBG", "34", msg)
-#define LOG_VERBOSE(msg) LOG_PRINT("VRB", "37", msg)
-#define LOG_TRACE() LOG_PRINT("TRC", "35", \
-                              << __FILE__ << ':' << __LINE__)
+#if MOSQUITTOASIO_LOG_LEVEL <= MOSQUITTOASIO_LOG_LEVEL_ERROR
+#define LOG_ERROR(msg) LOG_PRINT(::mosquittoasio::log::level::error, msg)
+#else
+#define LOG_ERROR(msg) LOG_DISABLED()
+#endif
+
+#if MOSQUITTOASIO_LOG_LEVEL <= MOSQUITTOASIO_LOG_LEVEL_WARNING
+#define LOG_WARNING(msg) LOG_PRINT(::mosquittoasio::log::level::warning, msg)
+#else
+#define LOG_WARNING(msg) LOG_DISABLED()
+#endif
+
+#if MOSQUITTOASIO_LOG_LEVEL <= MOSQUITTOASIO_LOG_LEVEL_NOTICE
+#define LOG_NOTICE(msg) LOG_PRINT(::mosquittoasio::log::level::notice, msg)
+#else
+#define LOG_NOTICE(msg) LOG_DISABLED()
+#endif
+
+#if MOSQUITTOASIO_LOG_LEVEL <= MOSQUITTOASIO_LOG_LEVEL_INFO
+#define LOG_INFO(msg) LOG_PRINT(::mosquittoasio::log::level::info, msg)
+#else
+#define LOG_INFO(msg) LOG_DISABLED()
+#endif
+
+#if MOSQUITTOASIO_LOG_LEVEL <= MOSQUITTOASIO_LOG_LEVEL_DEBUG
+#define LOG_DEBUG(msg) LOG_PRINT(::mosquittoasio::log::level::debug, msg)
+#else
+#define LOG_DEBUG(msg) LOG_DISABLED()
+#endif
+
+#if MOSQUITTOASIO_LOG_LEVEL <= MOSQUITTOASIO_LOG_LEVEL_VERBOSE
+#define LOG_VERBOSE(msg) LOG_PRINT(::mosquittoasio::log::level::verbose, msg)
+#else
+#define LOG_VERBOSE(msg) LOG_DISABLED()
+#endif
+
+#if MOSQUITTOASIO_LOG_LEVEL <= MOSQUITTOASIO_LOG_LEVEL_TRACE
+#define LOG_TRACE()                                     \
+    LOG_PRINT(::mosquittoasio::log::level::trace, \
+              << __FILE__ << ':' << __LINE__)
+#else
+#define LOG_TRACE() LOG_DISABLED()
+#endif
@@ -0,0 +1,393 @@
+#include "loopback_broker.hpp"
+
+#include "log.hpp"
+#include "topic_tree.hpp"
+
+#include <algorithm>
+
+namespace mosquittoasio {
+namespace mqtt {
+
+namespace {
+constexpr std::size_t initial_read_buffer = 4096;
+constexpr std::size_t max_gathered_packets = 64;
+}  // namespace
+
+class loopback_broker::session
+    : public std::enable_shared_from_this<session> {
+   public:
+    using error_code = boost::system::error_code;
+    using clock = std::chrono::steady_clock;
+
+    explicit session(loopback_broker& b)
+        : broker_(b),
+          socket_(b.io_),
+          timer_(b.io_),
+          read_buffer_(initial_read_buffer) {}
+
+    boost::asio::ip::tcp::socket& socket() { return socket_; }
+
+    void start() { await_read(); }
+    void close();
+
+    // the highest qos of the subscriptions matching the topic, or -1
+    int subscribed_qos(string_view topic) const;
+    void deliver(publish_packet const& pub, int qos);
+
+   private:
+    void await_read();
+    void handle_read(error_code ec, std::size_t bytes);
+    void handle_packet(packet const& p);
+    void handle_publish(packet const& p);
+    void handle_subscribe(packet const& p);
+    void handle_unsubscribe(packet const& p);
+
+    int next_mid();
+
+    // queues a packet, written once the injected latency elapsed
+    void send(std::string data);
+    void pump();
+    void handle_write(error_code ec);
+
+    loopback_broker& broker_;
+    boost::asio::ip::tcp::socket socket_;
+    boost::asio::steady_timer timer_;
+
+    std::vector<char> read_buffer_;
+    std::size_t read_end_{0};
+
+    bool connected_{false};
+    bool closed_{false};
+    std::vector<std::pair<std::string, int>> subscriptions_;
+    // qos 2 messages received and not released yet
+    std::unordered_set<int> incoming_;
+    std::uint16_t last_mid_{0};
+    std::size_t published_{0};
+
+    std::deque<std::pair<clock::time_point, std::string>> queue_;
+    std::vector<std::string> writing_;
+    std::vector<boost::asio::const_buffer> gather_;
+    bool waiting_{false};
+};
+
+void loopback_broker::session::close() {
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+    error_code ec;
+    socket_.close(ec);
+    timer_.cancel(ec);
+    broker_.remove(*this);
+}
+
+int loopback_broker::session::subscribed_qos(string_view topic) const {
+    auto qos = -1;
+    for (auto const& s : subscriptions_) {
+        if (s.second > qos && topic_matches(s.first, topic)) {
+            qos = s.second;
+        }
+    }
+    return qos;
+}
+
+void loopback_broker::session::deliver(publish_packet const& pub, int qos) {
+    std::string data;
+    encode_publish(data, pub.topic, pub.payload, qos, false, false,
+                   qos ? next_mid() : 0);
+    send(std::move(data));
+}
+
+void loopback_broker::session::await_read() {
+    if (read_end_ == read_buffer_.size()) {
+        read_buffer_.resize(read_buffer_.size() * 2);
+    }
+    auto self = shared_from_this();
+    socket_.async_read_some(
+        boost::asio::buffer(read_buffer_.data() + read_end_,
+                            read_buffer_.size() - read_end_),
+        [self](error_code ec, std::size_t bytes) {
+            self->handle_read(ec, bytes);
+        });
+}
+
+void loopback_broker::session::handle_read(error_code ec,
+                                           std::size_t bytes) {
+    if (closed_) {
+        return;
+    }
+    if (ec) {
+        close();
+        return;
+    }
+
+    read_end_ += bytes;
+    std::size_t begin = 0;
+    try {
+        packet p;
+        while (!closed_) {
+            auto size = decode(
+                string_view{read_buffer_.data() + begin, read_end_ - begin},
+                p);
+            if (!size) {
+                break;
+            }
+            handle_packet(p);
+            begin += size;
+        }
+    } catch (std::system_error const& e) {
+        LOG_ERROR(<< "mqtt::loopback_broker; malformed packet: "
+                  << e.what());
+        close();
+    }
+    if (closed_) {
+        return;
+    }
+
+    // keeps the incomplete packet at the start of the buffer
+    std::copy(read_buffer_.begin() + begin, read_buffer_.begin() + read_end_,
+              read_buffer_.begin());
+    read_end_ -= begin;
+    await_read();
+}
+
+void loopback_broker::session::handle_packet(packet const& p) {
+    if (!connected_ && p.type != packet_type::connect) {
+        close();
+        return;
+    }
+
+    std::string out;
+    switch (p.type) {
+        case packet_type::connect:
+            decode_connect(p);
+            connected_ = true;
+            encode_connack(out, false, 0);
+            break;
+        case packet_type::publish:
+            handle_publish(p);
+            break;
+        case packet_type::puback:
+        case packet_type::pubcomp:
+            // nothing is retransmitted, so nothing to release
+            break;
+        case packet_type::pubrec:
+            encode_ack(out, packet_type::pubrel, decode_mid(p));
+            break;
+        case packet_type::pubrel: {
+            auto mid = decode_mid(p);
+            incoming_.erase(mid);
+            encode_ack(out, packet_type::pubcomp, mid);
+            break;
+        }
+        case packet_type::subscribe:
+            handle_subscribe(p);
+            break;
+        case packet_type::unsubscribe:
+            handle_unsubscribe(p);
+            break;
+        case packet_type::pingreq:
+            encode_pingresp(out);
+            break;
+        case packet_type::disconnect:
+        default:
+            close();
+            break;
+    }
+    if (!out.empty()) {
+        send(std::move(out));
+    }
+}
+
+void loopback_broker::session::handle_publish(packet const& p) {
+    auto pub = decode_publish(p);
+    std::string ack;
+    auto route = true;
+    if (pub.qos == 1) {
+        encode_ack(ack, packet_type::puback, pub.mid);
+    } else if (pub.qos == 2) {
+        // a retransmission of a message not released yet is not routed again
+        route = incoming_.insert(pub.mid).second;
+        encode_ack(ack, packet_type::pubrec, pub.mid);
+    }
+    if (!ack.empty()) {
+        send(std::move(ack));
+    }
+
+    if (route) {
+        broker_.route(pub);
+    }
+
+    auto limit = broker_.options_.disconnect_after;
+    if (limit && ++published_ >= limit) {
+        close();
+    }
+}
+
+void loopback_broker::session::handle_subscribe(packet const& p) {
+    std::string granted;
+    auto mid = decode_subscribe(p, [&](string_view topic, int qos) {
+        qos = std::min(qos, 2);
+        auto it = std::find_if(
+            subscriptions_.begin(), subscriptions_.end(),
+            [&](std::pair<std::string, int> const& s) {
+                return s.first == topic;
+            });
+        if (it != subscriptions_.end()) {
+            it->second = qos;
+        } else {
+            subscriptions_.emplace_back(topic.to_string(), qos);
+        }
+        granted += static_cast<char>(qos);
+    });
+
+    std::string out;
+    encode_suback(out, mid, granted);
+    send(std::move(out));
+}
+
+void loopback_broker::session::handle_unsubscribe(packet const& p) {
+    auto mid = decode_unsubscribe(p, [&](string_view topic) {
+        subscriptions_.erase(
+            std::remove_if(subscriptions_.begin(), subscriptions_.end(),
+                           [&](std::pair<std::string, int> const& s) {
+                               return s.first == topic;
+                           }),
+            subscriptions_.end());
+    });
+
+    std::string out;
+    encode_ack(out, packet_type::unsuback, mid);
+    send(std::move(out));
+}
+
+int loopback_broker::session::next_mid() {
+    if (++last_mid_ == 0) {
+        last_mid_ = 1;
+    }
+    return last_mid_;
+}
+
+void loopback_broker::session::send(std::string data) {
+    queue_.emplace_back(clock::now() + broker_.options_.latency,
+                        std::move(data));
+    pump();
+}
+
+void loopback_broker::session::pump() {
+    if (closed_ || !writing_.empty() || waiting_ || queue_.empty()) {
+        return;
+    }
+
+    // every packet already due is written by a single gathered write
+    auto now = clock::now();
+    while (!queue_.empty() && queue_.front().first <= now &&
+           writing_.size() < max_gathered_packets) {
+        writing_.push_back(std::move(queue_.front().second));
+        queue_.pop_front();
+    }
+
+    auto self = shared_from_this();
+    if (writing_.empty()) {
+        waiting_ = true;
+        timer_.expires_at(queue_.front().first);
+        timer_.async_wait([self](error_code) {
+            self->waiting_ = false;
+            self->pump();
+        });
+        return;
+    }
+
+    gather_.clear();
+    for (auto const& data : writing_) {
+        gather_.push_back(boost::asio::buffer(data));
+    }
+    boost::asio::async_write(
+        socket_, gather_,
+        [self](error_code ec, std::size_t) { self->handle_write(ec); });
+}
+
+void loopback_broker::session::handle_write(error_code ec) {
+    writing_.clear();
+    if (closed_) {
+        return;
+    }
+    if (ec) {
+        close();
+        return;
+    }
+    pump();
+}
+
+loopback_broker::loopback_broker(io_service& io, options o)
+    : io_(io), options_(o), acceptor_(io) {
+    using boost::asio::ip::tcp;
+    auto endpoint =
+        tcp::endpoint{boost::asio::ip::address_v4::loopback(), o.port};
+    acceptor_.open(endpoint.protocol());
+    acceptor_.set_option(tcp::acceptor::reuse_address(true));
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+    port_ = acceptor_.local_endpoint().port();
+    await_accept();
+}
+
+loopback_broker::~loopback_broker() {
+    stop();
+}
+
+void loopback_broker::stop() {
+    stopped_ = true;
+    boost::system::error_code ec;
+    acceptor_.close(ec);
+    disconnect_all();
+}
+
+void loopback_broker::disconnect_all() {
+    // closing removes the session from the list
+    auto sessions = sessions_;
+    for (auto const& s : sessions) {
+        s->close();
+    }
+}
+
+void loopback_broker::await_accept() {
+    auto s = std::make_shared<session>(*this);
+    acceptor_.async_accept(
+        s->socket(), [this, s](boost::system::error_code ec) {
+            if (ec == boost::asio::error::operation_aborted) {
+                return;
+            }
+            if (stopped_) {
+                return;
+            }
+            if (!ec) {
+                boost::system::error_code ignored;
+                s->socket().set_option(
+                    boost::asio::ip::tcp::no_delay(true), ignored);
+                sessions_.push_back(s);
+                s->start();
+            }
+            await_accept();
+        });
+}
+
+void loopback_broker::route(publish_packet const& pub) {
+    ++published_;
+    for (auto const& s : sessions_) {
+        auto qos = s->subscribed_qos(pub.topic);
+        if (qos >= 0) {
+            s->deliver(pub, std::min(qos, pub.qos));
+        }
+    }
+}
+
+void loopback_broker::remove(session& s) {
+    sessions_.erase(
+        std::remove_if(sessions_.begin(), sessions_.end(),
+                       [&s](session_ptr const& p) { return p.get() == &s; }),
+        sessions_.end());
+}
+
+}  // namespace mqtt
+}  // namespace mosquittoasio
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "mqtt_codec.hpp"
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace mosquittoasio {
+namespace mqtt {
+
+// A minimal MQTT 3.1.1 broker listening on localhost, a stand-in for a real
+// broker on end to end tests and benchmarks. It handles CONNECT, SUBSCRIBE,
+// UNSUBSCRIBE, PUBLISH at qos 0, 1 and 2, PINGREQ and DISCONNECT; sessions
+// are never persisted and retained messages are not kept. Latency and
+// disconnections may be injected.
+// The broker is not thread safe, its io_service must be run from a single
+// thread, typically a thread of its own.
+class loopback_broker {
+   public:
+    using io_service = boost::asio::io_service;
+
+    struct options {
+        // zero picks a free port
+        unsigned short port{0};
+        // delay added to every packet the broker sends
+        std::chrono::microseconds latency{0};
+        // closes a connection once it published that many messages, zero
+        // never closes
+        std::size_t disconnect_after{0};
+    };
+
+    loopback_broker(io_service& io, options o);
+    explicit loopback_broker(io_service& io)
+        : loopback_broker(io, options{}) {}
+    ~loopback_broker();
+
+    loopback_broker(loopback_broker const&) = delete;
+    loopback_broker& operator=(loopback_broker const&) = delete;
+
+    unsigned short port() const { return port_; }
+
+    // stops accepting and closes every connection
+    void stop();
+    // closes every connection, clients are expected to reconnect
+    void disconnect_all();
+
+    std::size_t connection_count() const { return sessions_.size(); }
+    // messages received from clients
+    std::uint64_t published() const { return published_; }
+
+   private:
+    class session;
+    using session_ptr = std::shared_ptr<session>;
+
+    void await_accept();
+    void route(publish_packet const& pub);
+    void remove(session& s);
+
+    io_service& io_;
+    options options_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    unsigned short port_{0};
+    bool stopped_{false};
+
+    std::vector<session_ptr> sessions_;
+    std::uint64_t published_{0};
+};
+
+}  // namespace mqtt
+}  // namespace mosquittoasio
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "topic_table.hpp"
+#include "topic_tree.hpp"
+
+#include <boost/functional/hash.hpp>
+#include <boost/utility/string_view.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mosquittoasio {
+
+// Bounded cache of the values matched by concrete topics, evicting with the
+// clock algorithm: a hit marks its slot as referenced and the hand clears
+// those marks as it looks for a victim. Topics matching nothing are cached
+// as well. Interned topics are looked up by their id, in an array, instead
+// of hashing their name. Results must be invalidated by the owner whenever
+// a filter is added (invalidate_filter) or a value removed
+// (invalidate_value).
+template <typename Value>
+class match_cache {
+   public:
+    using string_view = boost::string_view;
+    using values_type = std::vector<Value>;
+
+    explicit match_cache(std::size_t capacity = 0) { reset(capacity); }
+
+    match_cache(match_cache const&) = delete;
+    match_cache& operator=(match_cache const&) = delete;
+
+    // drops every result, a zero capacity disables the cache
+    void reset(std::size_t capacity);
+    void clear() { reset(capacity_); }
+
+    std::size_t capacity() const { return capacity_; }
+    std::size_t size() const { return slots_.size() - free_.size(); }
+
+    // null on a miss, the result is valid until the next non const call; a
+    // topic is found by the id it was inserted with, if any
+    values_type const* find(string_view topic, topic_id id = invalid_topic_id);
+    void insert(string_view topic, values_type const& values,
+                topic_id id = invalid_topic_id);
+
+    // drops the results of the topics matched by the filter
+    void invalidate_filter(string_view filter);
+    // drops the results holding the value
+    void invalidate_value(Value const& value);
+
+    std::uint64_t hits() const { return hits_; }
+    std::uint64_t misses() const { return misses_; }
+
+   private:
+    struct slot {
+        std::string topic;
+        topic_id id{invalid_topic_id};
+        values_type values;
+        bool used{false};
+        bool referenced{false};
+    };
+
+    void drop(std::size_t i);
+
+    std::size_t capacity_{0};
+    // reserved up front, the index keys view the slot topics
+    std::vector<slot> slots_;
+    std::vector<std::size_t> free_;
+    // the topics inserted without an id
+    std::unordered_map<string_view, std::size_t, boost::hash<string_view>>
+        index_;
+    // the slot + 1 of the topics inserted with an id, zero when not cached
+    std::vector<std::size_t> ids_;
+    std::size_t hand_{0};
+
+    std::uint64_t hits_{0};
+    std::uint64_t misses_{0};
+};
+
+template <typename Value>
+void match_cache<Value>::reset(std::size_t capacity) {
+    index_.clear();
+    ids_.clear();
+    free_.clear();
+    slots_.clear();
+    slots_.shrink_to_fit();
+    slots_.reserve(capacity);
+    capacity_ = capacity;
+    hand_ = 0;
+}
+
+template <typename Value>
+auto match_cache<Value>::find(string_view topic, topic_id id)
+    -> values_type const* {
+    if (!capacity_) {
+        return nullptr;
+    }
+    std::size_t i;
+    if (id != invalid_topic_id) {
+        if (id >= ids_.size() || !ids_[id]) {
+            ++misses_;
+            return nullptr;
+        }
+        i = ids_[id] - 1;
+    } else {
+        auto it = index_.find(topic);
+        if (it == index_.end()) {
+            ++misses_;
+            return nullptr;
+        }
+        i = it->second;
+    }
+    ++hits_;
+    auto& s = slots_[i];
+    s.referenced = true;
+    return &s.values;
+}
+
+template <typename Value>
+void match_cache<Value>::insert(string_view topic, values_type const& values,
+                                topic_id id) {
+    if (!capacity_) {
+        return;
+    }
+    if (id != invalid_topic_id) {
+        if (id < ids_.size() && ids_[id]) {
+            return;
+        }
+    } else if (index_.count(topic)) {
+        return;
+    }
+
+    std::size_t i;
+    if (!free_.empty()) {
+        i = free_.back();
+        free_.pop_back();
+    } else if (slots_.size() < capacity_) {
+        i = slots_.size();
+        slots_.emplace_back();
+    } else {
+        // every slot is used, the first one not referenced since the hand
+        // last went by is evicted
+        while (slots_[hand_].referenced) {
+            slots_[hand_].referenced = false;
+            hand_ = (hand_ + 1) % capacity_;
+        }
+        i = hand_;
+        hand_ = (hand_ + 1) % capacity_;
+        drop(i);
+        free_.pop_back();
+    }
+
+    auto& s = slots_[i];
+    s.topic.assign(topic.data(), topic.size());
+    s.id = id;
+    s.values = values;
+    s.used = true;
+    s.referenced = false;
+    if (id != invalid_topic_id) {
+        if (id >= ids_.size()) {
+            ids_.resize(id + 1);
+        }
+        ids_[id] = i + 1;
+    } else {
+        index_.emplace(string_view{s.topic}, i);
+    }
+}
+
+template <typename Value>
+void match_cache<Value>::invalidate_filter(string_view filter) {
+    for (std::size_t i = 0; i < slots_.size(); ++i) {
+        if (slots_[i].used && topic_matches(filter, slots_[i].topic)) {
+            drop(i);
+        }
+    }
+}
+
+template <typename Value>
+void match_cache<Value>::invalidate_value(Value const& value) {
+    for (std::size_t i = 0; i < slots_.size(); ++i) {
+        auto const& values = slots_[i].values;
+        if (slots_[i].used &&
+            std::find(values.begin(), values.end(), value) != values.end()) {
+            drop(i);
+        }
+    }
+}
+
+template <typename Value>
+void match_cache<Value>::drop(std::size_t i) {
+    auto& s = slots_[i];
+    if (s.id != invalid_topic_id) {
+        ids_[s.id] = 0;
+    } else {
+        index_.erase(string_view{s.topic});
+    }
+    s.used = false;
+    s.referenced = false;
+    s.values.clear();
+    free_.push_back(i);
+}
+
+}  // namespace mosquittoasio
@@ -0,0 +1,75 @@
+#include "message.hpp"
+
+#include <cstring>
+
+namespace mosquittoasio {
+
+message::message(native::message_type const& msg)
+    : message(msg.topic,
+              {static_cast<char const*>(msg.payload),
+               static_cast<std::size_t>(msg.payloadlen)},
+              msg.qos, msg.retain, msg.mid) {
+}
+
+message::message(string_view topic, string_view payload, int qos,
+                 bool retain, int mid, topic_id id, buffer_pool* pool)
+    : topic_size_(topic.size()),
+      payload_size_(payload.size()),
+      topic_id_(id),
+      mid_(mid),
+      qos_(qos),
+      retain_(retain) {
+    // layout: topic unless interned, null terminator, payload
+    auto topic_bytes = id == invalid_topic_id ? topic_size_ + 1 : 0;
+    auto size = topic_bytes + payload_size_;
+    if (size) {
+        data_ = pool ? pool->acquire(size)
+                     : buffer_pool::buffer::allocate(size);
+    }
+    auto data = data_.data();
+
+    if (topic_bytes) {
+        std::memcpy(data, topic.data(), topic_size_);
+        data[topic_size_] = '\0';
+        topic_ = data;
+    } else {
+        topic_ = topic.data();
+    }
+    if (payload_size_) {
+        std::memcpy(data + topic_bytes, payload.data(), payload_size_);
+        payload_ = data + topic_bytes;
+    }
+}
+
+message::message(message const& other)
+    : data_(other.data_),
+      topic_(other.topic_),
+      payload_(other.payload_),
+      topic_size_(other.topic_size_),
+      payload_size_(other.payload_size_),
+      topic_id_(other.topic_id_),
+      mid_(other.mid_),
+      qos_(other.qos_),
+      retain_(other.retain_),
+      decoded_(std::atomic_load(&other.decoded_)) {
+}
+
+message& message::operator=(message const& other) {
+    if (this != &other) {
+        *this = message{other};
+    }
+    return *this;
+}
+
+auto message::find_decoded(decoded_ptr const& list, void const* type,
+                           void const* key) -> decoded_ptr {
+    for (auto d = list.get(); d; d = d->next.get()) {
+        if (d->type == type && d->key == key) {
+            // shares the ownership of the list head, which keeps d alive
+            return decoded_ptr{list, d};
+        }
+    }
+    return nullptr;
+}
+
+}  // namespace mosquittoasio
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "buffer_pool.hpp"
+#include "native.hpp"
+#include "topic_table.hpp"
+
+#include <boost/utility/string_view.hpp>
+
+#include <exception>
+#include <memory>
+
+namespace mosquittoasio {
+
+// a distinct address for each type, identifying it without rtti
+template <typename T>
+void const* type_key() {
+    static char const key = 0;
+    return &key;
+}
+
+// An inbound message; the topic and the payload are copied once from the
+// received packet into a single shared buffer, copies of a message share it.
+// An interned topic is not copied, the message views the interned name and
+// must not outlive its topic_table. With a pool the buffer is taken from
+// it and goes back once the last copy of the message is destroyed.
+// Payloads decoded through decode are cached on the message.
+class message {
+   public:
+    using string_view = boost::string_view;
+
+    message() = default;
+    explicit message(native::message_type const& msg);
+    message(string_view topic, string_view payload, int qos, bool retain,
+            int mid, topic_id id = invalid_topic_id,
+            buffer_pool* pool = nullptr);
+
+    // the decoded values are shared with the copy
+    message(message const& other);
+    message& operator=(message const& other);
+    message(message&&) = default;
+    message& operator=(message&&) = default;
+
+    // the topic view is null terminated
+    string_view topic() const { return {topic_, topic_size_}; }
+    string_view payload() const { return {payload_, payload_size_}; }
+    // invalid_topic_id unless the topic was interned
+    topic_id id() const { return topic_id_; }
+
+    int mid() const { return mid_; }
+    int qos() const { return qos_; }
+    bool retain() const { return retain_; }
+
+    // the payload decoded as a T by decoder, a callable taking the message
+    // and returning a T or throwing on failure; the first call for each T
+    // and key decodes, the next ones return the cached value or rethrow the
+    // cached failure, whatever decoder they pass: distinct decoders of the
+    // same T need distinct keys, such as their address. Thread safe, racing
+    // first calls may each decode, a single value is kept.
+    template <typename T, typename Decoder>
+    std::shared_ptr<T const> decode(Decoder&& decoder,
+                                    void const* key = nullptr) const;
+
+   private:
+    // decoded values, newest first, never modified once linked
+    struct decoded {
+        void const* type;
+        void const* key;
+        std::shared_ptr<void const> value;
+        std::exception_ptr error;
+        std::shared_ptr<decoded const> next;
+    };
+    using decoded_ptr = std::shared_ptr<decoded const>;
+
+    static decoded_ptr find_decoded(decoded_ptr const& list,
+                                    void const* type, void const* key);
+    template <typename T>
+    static std::shared_ptr<T const> value_of(decoded const& d);
+
+    buffer_pool::buffer data_;
+    char const* topic_{""};
+    char const* payload_{""};
+    std::size_t topic_size_{0};
+    std::size_t payload_size_{0};
+    topic_id topic_id_{invalid_topic_id};
+    int mid_{0};
+    int qos_{0};
+    bool retain_{false};
+    // only accessed atomically
+    mutable decoded_ptr decoded_;
+};
+
+template <typename T, typename Decoder>
+std::shared_ptr<T const> message::decode(Decoder&& decoder,
+                                         void const* key) const {
+    auto type = type_key<T>();
+    auto head = std::atomic_load(&decoded_);
+    if (auto found = find_decoded(head, type, key)) {
+        return value_of<T>(*found);
+    }
+
+    auto d = std::make_shared<decoded>();
+    d->type = type;
+    d->key = key;
+    try {
+        d->value = std::make_shared<T>(decoder(*this));
+    } catch (...) {
+        d->error = std::current_exception();
+    }
+
+    decoded_ptr linked = d;
+    do {
+        if (auto found = find_decoded(head, type, key)) {
+            linked = found;
+            break;
+        }
+        d->next = head;
+    } while (!std::atomic_compare_exchange_weak(&decoded_, &head, linked));
+    return value_of<T>(*linked);
+}
+
+template <typename T>
+std::shared_ptr<T const> message::value_of(decoded const& d) {
+    if (d.error) {
+        std::rethrow_exception(d.error);
+    }
+    return std::static_pointer_cast<T const>(d.value);
+}
+
+}  // namespace mosquittoasio
@@ -0,0 +1,171 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <memory>
+
+namespace mosquittoasio {
+namespace metrics {
+
+constexpr std::size_t histogram::sub_buckets;
+constexpr std::size_t histogram::bucket_count;
+
+std::uint64_t histogram_snapshot::quantile(double q) const {
+    if (!count) {
+        return 0;
+    }
+    auto rank = static_cast<std::uint64_t>(q * static_cast<double>(count));
+    if (rank >= count) {
+        rank = count - 1;
+    }
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen > rank) {
+            return std::min(histogram::upper_bound(i), max);
+        }
+    }
+    return max;
+}
+
+std::size_t histogram::bucket(std::uint64_t value) {
+    if (value < sub_buckets) {
+        return static_cast<std::size_t>(value);
+    }
+    // the position of the highest bit picks the power of two, the 3 bits
+    // below it the bucket inside it
+    auto exponent = 63 - __builtin_clzll(value);
+    auto sub = (value >> (exponent - 3)) & (sub_buckets - 1);
+    return static_cast<std::size_t>(exponent - 2) * sub_buckets +
+           static_cast<std::size_t>(sub);
+}
+
+std::uint64_t histogram::upper_bound(std::size_t bucket) {
+    if (bucket < sub_buckets) {
+        return bucket;
+    }
+    auto exponent = bucket / sub_buckets + 2;
+    auto sub = bucket % sub_buckets;
+    auto width = std::uint64_t{1} << (exponent - 3);
+    return (sub_buckets + sub) * width + width - 1;
+}
+
+histogram::~histogram() {
+    delete buckets_.load(std::memory_order_relaxed);
+}
+
+histogram::buckets_type& histogram::allocate_buckets() {
+    // concurrent first records race to install theirs, the losers free it
+    std::unique_ptr<buckets_type> fresh{new buckets_type{}};
+    buckets_type* current = nullptr;
+    if (buckets_.compare_exchange_strong(current, fresh.get(),
+                                         std::memory_order_acq_rel,
+                                         std::memory_order_acquire)) {
+        return *fresh.release();
+    }
+    return *current;
+}
+
+void histogram::record(std::uint64_t value) {
+    auto buckets = buckets_.load(std::memory_order_acquire);
+    auto& b = buckets ? *buckets : allocate_buckets();
+    b[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    auto max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(
+                              max, value, std::memory_order_relaxed)) {
+    }
+}
+
+histogram_snapshot histogram::snapshot() const {
+    histogram_snapshot s;
+    s.buckets.resize(bucket_count);
+    if (auto buckets = buckets_.load(std::memory_order_acquire)) {
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            s.buckets[i] = (*buckets)[i].load(std::memory_order_relaxed);
+            s.count += s.buckets[i];
+        }
+    }
+    s.sum = sum_.load(std::memory_order_relaxed);
+    s.max = max_.load(std::memory_order_relaxed);
+    return s;
+}
+
+namespace {
+
+void append_field(std::string& out, char const* name, std::uint64_t value) {
+    out += '"';
+    out += name;
+    out += "\":";
+    out += std::to_string(value);
+}
+
+}  // namespace
+
+void json_writer::add_counter(char const* name, char const*,
+                              counter const& c) {
+    if (out_.size() > 1) {
+        out_ += ',';
+    }
+    append_field(out_, name, c.value());
+}
+
+void json_writer::add_histogram(char const* name, char const*,
+                                histogram const& h) {
+    auto s = h.snapshot();
+    if (out_.size() > 1) {
+        out_ += ',';
+    }
+    out_ += '"';
+    out_ += name;
+    out_ += "\":{";
+    append_field(out_, "count", s.count);
+    out_ += ',';
+    append_field(out_, "sum", s.sum);
+    out_ += ',';
+    append_field(out_, "max", s.max);
+    out_ += ',';
+    append_field(out_, "p50", s.quantile(0.5));
+    out_ += ',';
+    append_field(out_, "p90", s.quantile(0.9));
+    out_ += ',';
+    append_field(out_, "p99", s.quantile(0.99));
+    out_ += ',';
+    append_field(out_, "p999", s.quantile(0.999));
+    out_ += '}';
+}
+
+void prometheus_writer::add_counter(char const* name, char const* help,
+                                    counter const& c) {
+    auto full = prefix_ + name + "_total";
+    out_ += "# HELP " + full + ' ' + help + '\n';
+    out_ += "# TYPE " + full + " counter\n";
+    out_ += full + ' ' + std::to_string(c.value()) + '\n';
+}
+
+void prometheus_writer::add_histogram(char const* name, char const* help,
+                                      histogram const& h) {
+    auto s = h.snapshot();
+    auto full = prefix_ + name;
+    out_ += "# HELP " + full + ' ' + help + '\n';
+    out_ += "# TYPE " + full + " histogram\n";
+
+    // a bucket per power of two, empty or not, so every scrape has the
+    // same layout; cumulative as the format requires, the last power of
+    // two is the +Inf bucket
+    std::uint64_t cumulative = 0;
+    for (std::size_t i = 0; i + 1 < s.buckets.size(); ++i) {
+        cumulative += s.buckets[i];
+        if (i % histogram::sub_buckets != histogram::sub_buckets - 1) {
+            continue;
+        }
+        out_ += full + "_bucket{le=\"" +
+                std::to_string(histogram::upper_bound(i)) + "\"} " +
+                std::to_string(cumulative) + '\n';
+    }
+    out_ += full + "_bucket{le=\"+Inf\"} " + std::to_string(s.count) + '\n';
+    out_ += full + "_sum " + std::to_string(s.sum) + '\n';
+    out_ += full + "_count " + std::to_string(s.count) + '\n';
+}
+
+}  // namespace metrics
+}  // namespace mosquittoasio
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mosquittoasio {
+namespace metrics {
+
+using clock = std::chrono::steady_clock;
+
+inline std::uint64_t elapsed_ns(clock::time_point since) {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() -
+                                                             since)
+            .count());
+}
+
+// may be updated from any thread, updates are relaxed and never ordered
+// with anything else
+class counter {
+   public:
+    void add(std::uint64_t n = 1) {
+        value_.fetch_add(n, std::memory_order_relaxed);
+    }
+    std::uint64_t value() const {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    std::atomic<std::uint64_t> value_{0};
+};
+
+struct histogram_snapshot {
+    std::uint64_t count{0};
+    std::uint64_t sum{0};
+    std::uint64_t max{0};
+    // counts by bucket, see histogram::upper_bound
+    std::vector<std::uint64_t> buckets;
+
+    // the upper bound of the bucket holding the quantile q, in [0, 1]
+    std::uint64_t quantile(double q) const;
+};
+
+// Log linear histogram: values below 8 get a bucket each and every power of
+// two above is split into 8 buckets, so a recorded value is reported with
+// an error below 12.5% whatever its magnitude. Recording is a few relaxed
+// atomic operations and may happen from any thread. The buckets are only
+// allocated by the first record, a histogram never recorded is 3 words.
+class histogram {
+   public:
+    static constexpr std::size_t sub_buckets = 8;
+    static constexpr std::size_t bucket_count = sub_buckets * 62;
+
+    histogram() = default;
+    ~histogram();
+
+    histogram(histogram const&) = delete;
+    histogram& operator=(histogram const&) = delete;
+
+    void record(std::uint64_t value);
+
+    // the counts are read one by one, concurrent records may be missing
+    histogram_snapshot snapshot() const;
+
+    static std::size_t bucket(std::uint64_t value);
+    // the largest value falling in the bucket
+    static std::uint64_t upper_bound(std::size_t bucket);
+
+   private:
+    using buckets_type = std::array<std::atomic<std::uint64_t>, bucket_count>;
+
+    buckets_type& allocate_buckets();
+
+    std::atomic<buckets_type*> buckets_{nullptr};
+    std::atomic<std::uint64_t> sum_{0};
+    std::atomic<std::uint64_t> max_{0};
+};
+
+// Exporters, they are handed every metric of a set by its visit function
+class json_writer {
+   public:
+    void add_counter(char const* name, char const* help, counter const& c);
+    void add_histogram(char const* name, char const* help,
+                       histogram const& h);
+    std::string str() const { return out_ + '}'; }
+
+   private:
+    std::string out_{"{"};
+};
+
+class prometheus_writer {
+   public:
+    explicit prometheus_writer(std::string prefix)
+        : prefix_(std::move(prefix)) {}
+
+    void add_counter(char const* name, char const* help, counter const& c);
+    void add_histogram(char const* name, char const* help,
+                       histogram const& h);
+    std::string const& str() const { return out_; }
+
+   private:
+    std::string prefix_;
+    std::string out_;
+};
+
+// one object with every metric as a member, read as a flat JSON object
+template <typename Metrics>
+std::string to_json(Metrics const& m) {
+    json_writer w;
+    m.visit(w);
+    return w.str();
+}
+
+// Prometheus text exposition format, names prefixed by prefix
+template <typename Metrics>
+std::string to_prometheus(Metrics const& m, std::string prefix) {
+    prometheus_writer w{std::move(prefix)};
+    m.visit(w);
+    return w.str();
+}
+
+}  // namespace metrics
+
+struct client_metrics {
+    metrics::counter messages_in;
+    metrics::counter bytes_in;
+    metrics::counter messages_out;
+    metrics::counter bytes_out;
+    metrics::counter socket_reads;
+    metrics::counter socket_writes;
+    metrics::counter connects;
+    metrics::counter disconnects;
+    metrics::counter reconnect_attempts;
+    // from reading a message to delivering it, the time spent queued
+    metrics::histogram delivery_latency_ns;
+    // spent by the message_received_signal subscribers on each message
+    metrics::histogram handler_latency_ns;
+    // from a connection failure to connecting again
+    metrics::histogram recovery_time_ns;
+
+    template <typename Writer>
+    void visit(Writer& w) const {
+        w.add_counter("messages_in", "Messages received", messages_in);
+        w.add_counter("bytes_in", "Topic and payload bytes received",
+                      bytes_in);
+        w.add_counter("messages_out", "Messages published", messages_out);
+        w.add_counter("bytes_out", "Topic and payload bytes published",
+                      bytes_out);
+        w.add_counter("socket_reads", "Socket read operations",
+                      socket_reads);
+        w.add_counter("socket_writes", "Socket write operations",
+                      socket_writes);
+        w.add_counter("connects", "Successful connections", connects);
+        w.add_counter("disconnects", "Disconnections", disconnects);
+        w.add_counter("reconnect_attempts", "Reconnection attempts",
+                      reconnect_attempts);
+        w.add_histogram("delivery_latency_ns",
+                        "Time from reading a message to delivering it",
+                        delivery_latency_ns);
+        w.add_histogram("handler_latency_ns",
+                        "Time spent by the handlers of a message",
+                        handler_latency_ns);
+        w.add_histogram("recovery_time_ns",
+                        "Time from a connection failure to connecting again",
+                        recovery_time_ns);
+    }
+};
+
+struct dispatcher_metrics {
+    metrics::counter messages;
+    metrics::counter matches;
+    metrics::counter unmatched;
+    // payloads decoded for typed subscriptions, and failing to
+    metrics::counter decodes;
+    metrics::counter decode_failures;
+    // matching entries of each message
+    metrics::histogram fan_out;
+    // spent by the matching handlers on each message
+    metrics::histogram handler_latency_ns;
+
+    template <typename Writer>
+    void visit(Writer& w) const {
+        w.add_counter("messages", "Messages dispatched", messages);
+        w.add_counter("matches", "Subscriptions matched by the messages",
+                      matches);
+        w.add_counter("unmatched", "Messages matching no subscription",
+                      unmatched);
+        w.add_counter("decodes", "Payloads decoded for typed subscriptions",
+                      decodes);
+        w.add_counter("decode_failures", "Payloads failing to decode",
+                      decode_failures);
+        w.add_histogram("fan_out", "Subscriptions matched by each message",
+                        fan_out);
+        w.add_histogram("handler_latency_ns",
+                        "Time spent by the handlers of a message",
+                        handler_latency_ns);
+    }
+};
+
+}  // namespace mosquittoasio
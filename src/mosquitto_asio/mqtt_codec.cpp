@@ -0,0 +1,236 @@
+#include "mqtt_codec.hpp"
+
+#include "error.hpp"
+
+namespace mosquittoasio {
+namespace mqtt {
+namespace detail {
+
+void throw_protocol_error() {
+    throw std::system_error{make_error_code(errc::protocol)};
+}
+
+int get_u16(string_view& in) {
+    if (in.size() < 2) {
+        throw_protocol_error();
+    }
+    auto value = (static_cast<std::uint8_t>(in[0]) << 8) |
+                 static_cast<std::uint8_t>(in[1]);
+    in.remove_prefix(2);
+    return value;
+}
+
+string_view get_string(string_view& in) {
+    auto size = static_cast<std::size_t>(get_u16(in));
+    if (in.size() < size) {
+        throw_protocol_error();
+    }
+    auto s = in.substr(0, size);
+    in.remove_prefix(size);
+    return s;
+}
+
+}  // namespace detail
+
+namespace {
+
+using detail::get_string;
+using detail::get_u16;
+using detail::throw_protocol_error;
+
+constexpr std::size_t max_remaining_length = 268435455;
+
+void put_fixed_header(std::string& out, std::uint8_t first,
+                      std::size_t remaining) {
+    if (remaining > max_remaining_length) {
+        throw std::system_error{make_error_code(errc::payload_size)};
+    }
+    out += static_cast<char>(first);
+    do {
+        auto byte = static_cast<std::uint8_t>(remaining % 128);
+        remaining /= 128;
+        if (remaining) {
+            byte |= 0x80;
+        }
+        out += static_cast<char>(byte);
+    } while (remaining);
+}
+
+void put_u16(std::string& out, std::size_t value) {
+    out += static_cast<char>((value >> 8) & 0xff);
+    out += static_cast<char>(value & 0xff);
+}
+
+void put_string(std::string& out, string_view s) {
+    if (s.size() > 0xffff) {
+        throw std::system_error{make_error_code(errc::invalid_parameters)};
+    }
+    put_u16(out, s.size());
+    out.append(s.data(), s.size());
+}
+
+std::uint8_t first_byte(packet_type type, std::uint8_t flags = 0) {
+    return static_cast<std::uint8_t>(type) << 4 | flags;
+}
+
+}  // namespace
+
+void encode_connect(std::string& out, string_view client_id,
+                    bool clean_session, int keep_alive) {
+    // protocol name, level, flags and keep alive, then the payload
+    auto remaining = 10 + 2 + client_id.size();
+    put_fixed_header(out, first_byte(packet_type::connect), remaining);
+    put_string(out, "MQTT");
+    out += static_cast<char>(4);
+    out += static_cast<char>(clean_session ? 0x02 : 0x00);
+    put_u16(out, keep_alive);
+    put_string(out, client_id);
+}
+
+void encode_publish(std::string& out, string_view topic, string_view payload,
+                    int qos, bool retain, bool dup, int mid) {
+    auto flags = static_cast<std::uint8_t>((dup ? 0x08 : 0) | (qos << 1) |
+                                           (retain ? 0x01 : 0));
+    auto remaining = 2 + topic.size() + (qos ? 2 : 0) + payload.size();
+
+    out.reserve(out.size() + 5 + remaining);
+    put_fixed_header(out, first_byte(packet_type::publish, flags), remaining);
+    put_string(out, topic);
+    if (qos) {
+        put_u16(out, mid);
+    }
+    out.append(payload.data(), payload.size());
+}
+
+void encode_ack(std::string& out, packet_type type, int mid) {
+    auto flags = static_cast<std::uint8_t>(type == packet_type::pubrel ? 0x02 : 0);
+    put_fixed_header(out, first_byte(type, flags), 2);
+    put_u16(out, mid);
+}
+
+void encode_subscribe(std::string& out, int mid, string_view topic, int qos) {
+    put_fixed_header(out, first_byte(packet_type::subscribe, 0x02),
+                     2 + 2 + topic.size() + 1);
+    put_u16(out, mid);
+    put_string(out, topic);
+    out += static_cast<char>(qos);
+}
+
+void encode_unsubscribe(std::string& out, int mid, string_view topic) {
+    put_fixed_header(out, first_byte(packet_type::unsubscribe, 0x02),
+                     2 + 2 + topic.size());
+    put_u16(out, mid);
+    put_string(out, topic);
+}
+
+void encode_pingreq(std::string& out) {
+    put_fixed_header(out, first_byte(packet_type::pingreq), 0);
+}
+
+void encode_disconnect(std::string& out) {
+    put_fixed_header(out, first_byte(packet_type::disconnect), 0);
+}
+
+void encode_connack(std::string& out, bool session_present, int rc) {
+    put_fixed_header(out, first_byte(packet_type::connack), 2);
+    out += static_cast<char>(session_present ? 0x01 : 0x00);
+    out += static_cast<char>(rc);
+}
+
+void encode_suback(std::string& out, int mid, string_view granted) {
+    put_fixed_header(out, first_byte(packet_type::suback), 2 + granted.size());
+    put_u16(out, mid);
+    out.append(granted.data(), granted.size());
+}
+
+void encode_pingresp(std::string& out) {
+    put_fixed_header(out, first_byte(packet_type::pingresp), 0);
+}
+
+void set_dup(std::string& publish) {
+    publish[0] = static_cast<char>(publish[0] | 0x08);
+}
+
+std::size_t decode(string_view data, packet& p) {
+    if (data.size() < 2) {
+        return 0;
+    }
+
+    std::size_t remaining = 0;
+    std::size_t header = 1;
+    for (std::size_t multiplier = 1;; multiplier *= 128) {
+        if (header == 5) {
+            throw_protocol_error();
+        }
+        if (header == data.size()) {
+            return 0;
+        }
+        auto byte = static_cast<std::uint8_t>(data[header++]);
+        remaining += (byte & 0x7f) * multiplier;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+
+    if (data.size() < header + remaining) {
+        return 0;
+    }
+
+    auto first = static_cast<std::uint8_t>(data[0]);
+    p.type = static_cast<packet_type>(first >> 4);
+    p.flags = first & 0x0f;
+    p.body = data.substr(header, remaining);
+    return header + remaining;
+}
+
+publish_packet decode_publish(packet const& p) {
+    publish_packet pub;
+    pub.qos = (p.flags >> 1) & 0x03;
+    pub.retain = p.flags & 0x01;
+    pub.dup = p.flags & 0x08;
+    if (pub.qos == 3) {
+        throw_protocol_error();
+    }
+
+    auto body = p.body;
+    pub.topic = get_string(body);
+    pub.mid = pub.qos ? get_u16(body) : 0;
+    pub.payload = body;
+    return pub;
+}
+
+int decode_mid(packet const& p) {
+    auto body = p.body;
+    return get_u16(body);
+}
+
+int decode_connack(packet const& p) {
+    if (p.body.size() != 2) {
+        throw_protocol_error();
+    }
+    return static_cast<std::uint8_t>(p.body[1]);
+}
+
+connect_packet decode_connect(packet const& p) {
+    auto body = p.body;
+    auto protocol = get_string(body);
+    if (protocol != "MQTT" || body.size() < 4) {
+        throw_protocol_error();
+    }
+    auto level = static_cast<std::uint8_t>(body[0]);
+    auto flags = static_cast<std::uint8_t>(body[1]);
+    body.remove_prefix(2);
+    if (level != 4) {
+        throw_protocol_error();
+    }
+
+    connect_packet c;
+    c.clean_session = flags & 0x02;
+    c.keep_alive = get_u16(body);
+    c.client_id = get_string(body);
+    // the will, user name and password that may follow are ignored
+    return c;
+}
+
+}  // namespace mqtt
+}  // namespace mosquittoasio
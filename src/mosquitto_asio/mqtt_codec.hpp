@@ -0,0 +1,133 @@
+#pragma once
+
+#include <boost/utility/string_view.hpp>
+
+#include <cstdint>
+#include <string>
+
+namespace mosquittoasio {
+namespace mqtt {
+
+// MQTT 3.1.1 control packets, the encoders append a whole packet to out and
+// the decoders throw std::system_error with errc::protocol on malformed data
+
+using string_view = boost::string_view;
+
+enum class packet_type : std::uint8_t {
+    connect = 1,
+    connack = 2,
+    publish = 3,
+    puback = 4,
+    pubrec = 5,
+    pubrel = 6,
+    pubcomp = 7,
+    subscribe = 8,
+    suback = 9,
+    unsubscribe = 10,
+    unsuback = 11,
+    pingreq = 12,
+    pingresp = 13,
+    disconnect = 14
+};
+
+struct packet {
+    packet_type type;
+    std::uint8_t flags;
+    string_view body;
+};
+
+struct connect_packet {
+    string_view client_id;
+    bool clean_session;
+    int keep_alive;
+};
+
+struct publish_packet {
+    string_view topic;
+    string_view payload;
+    int qos;
+    bool retain;
+    bool dup;
+    int mid;
+};
+
+void encode_connect(std::string& out, string_view client_id,
+                    bool clean_session, int keep_alive);
+void encode_publish(std::string& out, string_view topic, string_view payload,
+                    int qos, bool retain, bool dup, int mid);
+// puback, pubrec, pubrel, pubcomp and unsuback
+void encode_ack(std::string& out, packet_type type, int mid);
+void encode_subscribe(std::string& out, int mid, string_view topic, int qos);
+void encode_unsubscribe(std::string& out, int mid, string_view topic);
+void encode_pingreq(std::string& out);
+void encode_disconnect(std::string& out);
+
+// the packets only sent by a broker
+void encode_connack(std::string& out, bool session_present, int rc);
+// one granted qos, or 0x80 for a failure, by requested topic
+void encode_suback(std::string& out, int mid, string_view granted);
+void encode_pingresp(std::string& out);
+
+// marks an encoded publish as a retransmission
+void set_dup(std::string& publish);
+
+// decodes the first packet of data, returns its size or zero if data does
+// not hold a whole packet yet; the body is a view of data
+std::size_t decode(string_view data, packet& p);
+
+publish_packet decode_publish(packet const& p);
+// the message id of acks
+int decode_mid(packet const& p);
+// the connect return code
+int decode_connack(packet const& p);
+
+// the packets only received by a broker, the subscribe and unsubscribe
+// decoders call f(topic, qos) and f(topic) for each topic and return the
+// message id
+connect_packet decode_connect(packet const& p);
+template <typename Function>
+int decode_subscribe(packet const& p, Function&& f);
+template <typename Function>
+int decode_unsubscribe(packet const& p, Function&& f);
+
+namespace detail {
+// splits the first field out of in
+int get_u16(string_view& in);
+string_view get_string(string_view& in);
+void throw_protocol_error();
+}  // namespace detail
+
+template <typename Function>
+int decode_subscribe(packet const& p, Function&& f) {
+    auto body = p.body;
+    auto mid = detail::get_u16(body);
+    if (body.empty()) {
+        detail::throw_protocol_error();
+    }
+    while (!body.empty()) {
+        auto topic = detail::get_string(body);
+        if (body.empty()) {
+            detail::throw_protocol_error();
+        }
+        auto qos = static_cast<std::uint8_t>(body[0]);
+        body.remove_prefix(1);
+        f(topic, static_cast<int>(qos));
+    }
+    return mid;
+}
+
+template <typename Function>
+int decode_unsubscribe(packet const& p, Function&& f) {
+    auto body = p.body;
+    auto mid = detail::get_u16(body);
+    if (body.empty()) {
+        detail::throw_protocol_error();
+    }
+    while (!body.empty()) {
+        f(detail::get_string(body));
+    }
+    return mid;
+}
+
+}  // namespace mqtt
+}  // namespace mosquittoasio
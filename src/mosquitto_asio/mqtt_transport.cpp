@@ -0,0 +1,647 @@
+#include "mqtt_transport.hpp"
+
+#include "error.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace mosquittoasio {
+namespace mqtt {
+namespace {
+
+// every connection reads into a buffer of its own, of this size while idle,
+// grown for the packets larger than it and while reads fill it, and shrunk
+// back once drained when no read used a quarter of it for a while; the ping
+// responses keep an idle connection reading
+constexpr std::size_t min_read_buffer = 512;
+constexpr std::size_t max_streaming_read_buffer = 64 * 1024;
+constexpr std::chrono::seconds read_buffer_idle{1};
+
+constexpr std::chrono::seconds connack_timeout{30};
+
+void throw_no_connection() {
+    throw std::system_error{make_error_code(errc::no_connection)};
+}
+
+}  // namespace
+
+transport::transport(io_service& io, strand_type& strand,
+                     std::string client_id, bool clean_session, callbacks cb,
+                     client_metrics& metrics,
+                     std::shared_ptr<handler_allocator> allocator)
+    : strand_(strand),
+      resolver_(io),
+      socket_(io),
+      keep_alive_timer_(io),
+      callbacks_(std::move(cb)),
+      metrics_(metrics),
+      allocator_(std::move(allocator)),
+      client_id_(std::move(client_id)),
+      clean_session_(clean_session) {
+}
+
+transport::~transport() {
+    error_code ec;
+    socket_.close(ec);
+}
+
+void transport::connect(std::string host, int port, int keep_alive) {
+    host_ = std::move(host);
+    port_ = port;
+    keep_alive_ = keep_alive;
+    reconnect();
+}
+
+void transport::reconnect() {
+    using resolver = boost::asio::ip::tcp::resolver;
+
+    error_code ec;
+    socket_.close(ec);
+    ++generation_;
+
+    resolver_.async_resolve(
+        resolver::query{host_, std::to_string(port_)},
+        strand_.wrap(bind_allocator([this](error_code ec,
+                                           resolver::iterator it) {
+            handle_resolve(ec, it);
+        })));
+}
+
+void transport::handle_resolve(error_code ec,
+                               boost::asio::ip::tcp::resolver::iterator it) {
+    if (ec == boost::asio::error::operation_aborted) {
+        return;
+    }
+    if (ec) {
+        LOG_ERROR(<< "mqtt::transport::handle_resolve; failed ec:" << ec
+                  << " msg:" << ec.message());
+        callbacks_.on_connect(static_cast<int>(errc::eai));
+        return;
+    }
+
+    boost::asio::async_connect(
+        socket_, it,
+        strand_.wrap(bind_allocator(
+            [this](error_code ec, boost::asio::ip::tcp::resolver::iterator) {
+                handle_connect(ec);
+            })));
+}
+
+void transport::handle_connect(error_code ec) {
+    if (ec == boost::asio::error::operation_aborted) {
+        return;
+    }
+    if (ec) {
+        LOG_ERROR(<< "mqtt::transport::handle_connect; failed ec:" << ec
+                  << " msg:" << ec.message());
+        callbacks_.on_connect(static_cast<int>(errc::no_connection));
+        return;
+    }
+
+    socket_.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+
+    read_begin_ = read_end_ = 0;
+    if (read_buffer_.size() < min_read_buffer) {
+        read_buffer_.resize(min_read_buffer);
+    }
+    ping_outstanding_ = false;
+    incoming_.clear();
+    await_read();
+
+    // only the connect packet goes out until the connack arrives
+    std::string connect;
+    encode_connect(connect, client_id_, clean_session_, keep_alive_);
+    bool start;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        queue_.clear();
+        writing_ = false;
+        writing_count_ = 0;
+        start = enqueue(std::move(connect));
+    }
+    if (start) {
+        post_write();
+    }
+    await_connack();
+}
+
+void transport::await_read() {
+    // makes room by moving the partial packet to the front, growing the
+    // buffer only when a single packet does not fit in it
+    if (read_begin_ &&
+        read_buffer_.size() - read_end_ < read_buffer_.size() / 4) {
+        std::memmove(read_buffer_.data(), read_buffer_.data() + read_begin_,
+                     read_end_ - read_begin_);
+        read_end_ -= read_begin_;
+        read_begin_ = 0;
+    }
+    if (read_end_ == read_buffer_.size()) {
+        read_buffer_.resize(std::max(read_buffer_.size() * 2, min_read_buffer));
+    }
+
+    auto generation = generation_;
+    socket_.async_read_some(
+        boost::asio::buffer(read_buffer_.data() + read_end_,
+                            read_buffer_.size() - read_end_),
+        strand_.wrap(bind_allocator(
+            [this, generation](error_code ec, std::size_t bytes) {
+                handle_read(generation, ec, bytes);
+            })));
+}
+
+void transport::handle_read(unsigned generation, error_code ec,
+                            std::size_t bytes) {
+    if (generation != generation_) {
+        return;
+    }
+    metrics_.socket_reads.add();
+    if (ec) {
+        LOG_ERROR(<< "mqtt::transport::handle_read; failed ec:" << ec
+                  << " msg:" << ec.message());
+        connection_lost();
+        return;
+    }
+
+    // a read filling the buffer likely left more behind
+    auto filled = read_end_ + bytes == read_buffer_.size();
+    auto busy = bytes > read_buffer_.size() / 4;
+    read_end_ += bytes;
+    std::size_t used;
+    if (!handle_packets(read_buffer_.data() + read_begin_,
+                        read_end_ - read_begin_, generation, used)) {
+        return;
+    }
+    read_begin_ += used;
+
+    if (busy) {
+        last_busy_read_ = clock::now();
+    }
+    if (filled && read_buffer_.size() < max_streaming_read_buffer) {
+        read_buffer_.resize(read_buffer_.size() * 2);
+    }
+    if (read_begin_ == read_end_) {
+        read_begin_ = read_end_ = 0;
+        if (read_buffer_.size() > min_read_buffer && !busy &&
+            clock::now() - last_busy_read_ >= read_buffer_idle) {
+            std::vector<char>(min_read_buffer).swap(read_buffer_);
+        }
+    }
+    await_read();
+}
+
+bool transport::handle_packets(char const* data, std::size_t size,
+                               unsigned generation, std::size_t& used) {
+    used = 0;
+    try {
+        packet p;
+        while (auto n = decode({data + used, size - used}, p)) {
+            handle_packet(p);
+            // a callback may have lost the connection
+            if (generation != generation_) {
+                return false;
+            }
+            used += n;
+        }
+    } catch (std::system_error const& e) {
+        LOG_ERROR(<< "mqtt::transport::handle_packets; malformed packet: "
+                  << e.what());
+        connection_lost();
+        return false;
+    }
+    return true;
+}
+
+void transport::handle_packet(packet const& p) {
+    switch (p.type) {
+        case packet_type::connack:
+            handle_connack(p);
+            break;
+        case packet_type::publish:
+            handle_publish(p);
+            break;
+        case packet_type::puback:
+        case packet_type::pubcomp: {
+            auto mid = decode_mid(p);
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                auto it = inflight_index_.find(mid);
+                if (it == inflight_index_.end()) {
+                    return;
+                }
+                inflight_.erase(it->second);
+                inflight_index_.erase(it);
+            }
+            callbacks_.on_publish(mid);
+            break;
+        }
+        case packet_type::pubrec: {
+            auto mid = decode_mid(p);
+            std::string pubrel;
+            encode_ack(pubrel, packet_type::pubrel, mid);
+
+            bool start = false;
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                auto it = inflight_index_.find(mid);
+                if (it == inflight_index_.end()) {
+                    return;
+                }
+                // the pubrel replaces the message when resending
+                auto& i = *it->second;
+                i.released = true;
+                i.data = std::make_shared<std::string>(std::move(pubrel));
+                start = enqueue(i.data);
+            }
+            if (start) {
+                post_write();
+            }
+            break;
+        }
+        case packet_type::pubrel: {
+            auto mid = decode_mid(p);
+            incoming_.erase(mid);
+            std::string pubcomp;
+            encode_ack(pubcomp, packet_type::pubcomp, mid);
+            bool start;
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                start = enqueue(std::move(pubcomp));
+            }
+            if (start) {
+                post_write();
+            }
+            break;
+        }
+        case packet_type::pingresp:
+            ping_outstanding_ = false;
+            break;
+        case packet_type::suback:
+        case packet_type::unsuback:
+            break;
+        default:
+            throw std::system_error{make_error_code(errc::protocol)};
+    }
+}
+
+void transport::handle_connack(packet const& p) {
+    auto rc = decode_connack(p);
+    // the connack timeout
+    keep_alive_timer_.cancel();
+    if (rc) {
+        error_code ec;
+        socket_.close(ec);
+        ++generation_;
+        callbacks_.on_connect(rc);
+        return;
+    }
+
+    // messages not completed on the previous connection are sent again, in
+    // their original order [MQTT-4.6.0-1]
+    bool start = false;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        connected_ = true;
+        for (auto& i : inflight_) {
+            // only a publish already written is a duplicate [MQTT-3.3.1-1]
+            if (!i.released && i.written) {
+                set_dup(*i.data);
+            }
+            start = enqueue(i.data, 0, i.mid) || start;
+        }
+    }
+    if (start) {
+        post_write();
+    }
+
+    last_write_ = clock::now();
+    await_keep_alive();
+    callbacks_.on_connect(0);
+}
+
+void transport::handle_publish(packet const& p) {
+    auto pub = decode_publish(p);
+
+    auto deliver = true;
+    std::string ack;
+    if (pub.qos == 1) {
+        encode_ack(ack, packet_type::puback, pub.mid);
+    } else if (pub.qos == 2) {
+        // a duplicate is only acknowledged again
+        deliver = incoming_.insert(pub.mid).second;
+        encode_ack(ack, packet_type::pubrec, pub.mid);
+    }
+
+    if (!ack.empty()) {
+        bool start;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            start = enqueue(std::move(ack));
+        }
+        if (start) {
+            post_write();
+        }
+    }
+
+    if (deliver) {
+        callbacks_.on_message(pub);
+    }
+}
+
+void transport::await_connack() {
+    auto timeout = keep_alive_ ? std::chrono::seconds(keep_alive_)
+                               : connack_timeout;
+    auto generation = generation_;
+    keep_alive_timer_.expires_from_now(timeout);
+    keep_alive_timer_.async_wait(
+        strand_.wrap(bind_allocator([this, generation](error_code ec) {
+            handle_connack_timeout(generation, ec);
+        })));
+}
+
+void transport::handle_connack_timeout(unsigned generation, error_code ec) {
+    if (ec == boost::asio::error::operation_aborted ||
+        generation != generation_) {
+        return;
+    }
+    LOG_ERROR(<< "mqtt::transport::handle_connack_timeout; no connack");
+    connection_lost();
+}
+
+void transport::await_keep_alive() {
+    if (!keep_alive_) {
+        return;
+    }
+    // the broker only needs a packet every keep alive period, and the
+    // response to a ping within the next one
+    auto period = std::chrono::seconds(keep_alive_);
+    auto deadline = last_write_ + period;
+    auto now = clock::now();
+    if (ping_outstanding_ || deadline <= now) {
+        deadline = now + period;
+    }
+    auto generation = generation_;
+    keep_alive_timer_.expires_at(deadline);
+    keep_alive_timer_.async_wait(
+        strand_.wrap(bind_allocator([this, generation](error_code ec) {
+            handle_keep_alive(generation, ec);
+        })));
+}
+
+void transport::handle_keep_alive(unsigned generation, error_code ec) {
+    if (ec == boost::asio::error::operation_aborted ||
+        generation != generation_) {
+        return;
+    }
+    if (ping_outstanding_) {
+        LOG_ERROR(<< "mqtt::transport::handle_keep_alive; no ping response");
+        connection_lost();
+        return;
+    }
+
+    // the broker only needs a ping when nothing else was sent
+    auto idle = clock::now() - last_write_;
+    if (idle >= std::chrono::seconds(keep_alive_)) {
+        std::string ping;
+        encode_pingreq(ping);
+        ping_outstanding_ = true;
+        bool start;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            start = enqueue(std::move(ping));
+        }
+        if (start) {
+            post_write();
+        }
+    }
+    await_keep_alive();
+}
+
+int transport::publish(string_view topic, string_view payload, int qos,
+                       bool retain) {
+    bool start = false;
+    int mid;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (!qos && !connected_) {
+            throw_no_connection();
+        }
+
+        mid = next_mid();
+        auto data = std::make_shared<std::string>();
+        encode_publish(*data, topic, payload, qos, retain, false, mid);
+        if (qos) {
+            inflight_index_.emplace(
+                mid, inflight_.insert(inflight_.end(),
+                                      inflight{data, mid, qos, false, false}));
+        }
+        if (connected_) {
+            start = qos ? enqueue(std::move(data), 0, mid)
+                        : enqueue(std::move(data), mid);
+        }
+    }
+    if (start) {
+        post_write();
+    }
+    return mid;
+}
+
+int transport::subscribe(string_view topic, int qos) {
+    bool start;
+    int mid;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (!connected_) {
+            return 0;
+        }
+        mid = next_mid();
+        std::string data;
+        encode_subscribe(data, mid, topic, qos);
+        start = enqueue(std::move(data));
+    }
+    if (start) {
+        post_write();
+    }
+    return mid;
+}
+
+int transport::unsubscribe(string_view topic) {
+    bool start;
+    int mid;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (!connected_) {
+            return 0;
+        }
+        mid = next_mid();
+        std::string data;
+        encode_unsubscribe(data, mid, topic);
+        start = enqueue(std::move(data));
+    }
+    if (start) {
+        post_write();
+    }
+    return mid;
+}
+
+void transport::cork() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    ++corked_;
+}
+
+void transport::uncork() {
+    bool start = false;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (--corked_ == 0 && !queue_.empty() && !writing_ &&
+            !write_scheduled_) {
+            write_scheduled_ = true;
+            start = true;
+        }
+    }
+    if (start) {
+        post_write();
+    }
+}
+
+void transport::set_write_budget(std::size_t packets) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    write_budget_ = packets;
+}
+
+bool transport::enqueue(data_type data, int completed_mid,
+                        int inflight_mid) {
+    queue_.push_back(outgoing{std::move(data), completed_mid, inflight_mid});
+    if (corked_ || writing_ || write_scheduled_) {
+        return false;
+    }
+    write_scheduled_ = true;
+    return true;
+}
+
+bool transport::enqueue(std::string data) {
+    return enqueue(std::make_shared<std::string>(std::move(data)));
+}
+
+int transport::next_mid() {
+    // skips the ids still awaiting an acknowledgement
+    do {
+        if (++last_mid_ == 0) {
+            last_mid_ = 1;
+        }
+    } while (inflight_index_.count(last_mid_));
+    return last_mid_;
+}
+
+void transport::post_write() {
+    strand_.post(bind_allocator([this] { start_write(); }));
+}
+
+void transport::start_write() {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        write_scheduled_ = false;
+        if (writing_ || corked_ || queue_.empty() || !socket_.is_open()) {
+            return;
+        }
+
+        writing_count_ = std::min(queue_.size(), write_budget_);
+        gather_.clear();
+        for (std::size_t i = 0; i < writing_count_; ++i) {
+            gather_.push_back(boost::asio::buffer(*queue_[i].data));
+        }
+        writing_ = true;
+    }
+
+    auto generation = generation_;
+    auto buffers = buffer_sequence{gather_.data(),
+                                   gather_.data() + gather_.size()};
+    boost::asio::async_write(
+        socket_, buffers,
+        strand_.wrap(bind_allocator(
+            [this, generation](error_code ec, std::size_t bytes) {
+                handle_write(generation, ec, bytes);
+            })));
+}
+
+void transport::handle_write(unsigned generation, error_code ec,
+                             std::size_t bytes) {
+    if (generation != generation_) {
+        return;
+    }
+    metrics_.socket_writes.add();
+    mark_written(bytes);
+    if (ec) {
+        LOG_ERROR(<< "mqtt::transport::handle_write; failed ec:" << ec
+                  << " msg:" << ec.message());
+        connection_lost();
+        return;
+    }
+    last_write_ = clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        writing_ = false;
+        for (std::size_t i = 0; i < writing_count_; ++i) {
+            if (queue_.front().completed_mid) {
+                completed_.push_back(queue_.front().completed_mid);
+            }
+            queue_.pop_front();
+        }
+        writing_count_ = 0;
+    }
+
+    for (auto mid : completed_) {
+        callbacks_.on_publish(mid);
+    }
+    completed_.clear();
+
+    start_write();
+}
+
+void transport::mark_written(std::size_t bytes) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    for (std::size_t i = 0; i < writing_count_; ++i) {
+        auto const& o = queue_[i];
+        if (o.data->size() > bytes) {
+            break;
+        }
+        bytes -= o.data->size();
+        if (!o.inflight_mid) {
+            continue;
+        }
+        // the message may have been acknowledged and its id reused meanwhile
+        auto it = inflight_index_.find(o.inflight_mid);
+        if (it != inflight_index_.end() && it->second->data == o.data) {
+            it->second->written = true;
+        }
+    }
+}
+
+void transport::connection_lost() {
+    error_code ec;
+    socket_.close(ec);
+    keep_alive_timer_.cancel();
+    ++generation_;
+
+    bool was_connected;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        // qos 0 packets are dropped, qos 1 and 2 remain in flight
+        was_connected = connected_;
+        connected_ = false;
+        queue_.clear();
+        writing_ = false;
+        writing_count_ = 0;
+    }
+
+    // lost before the connack, the client retries as for any failed attempt
+    if (!was_connected) {
+        callbacks_.on_connect(static_cast<int>(errc::connection_lost));
+        return;
+    }
+    callbacks_.on_disconnect(static_cast<int>(errc::connection_lost));
+}
+
+}  // namespace mqtt
+}  // namespace mosquittoasio
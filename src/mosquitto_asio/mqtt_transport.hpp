@@ -0,0 +1,193 @@
+#pragma once
+
+#include "handler_allocator.hpp"
+#include "metrics.hpp"
+#include "mqtt_codec.hpp"
+#include "timer_wheel.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/container/deque.hpp>
+
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace mosquittoasio {
+namespace mqtt {
+
+// An MQTT 3.1.1 client connection speaking the protocol directly over an
+// asio socket: reads go into a small buffer of the connection, grown while
+// a packet does not fit in it or reads fill it, and are decoded in place,
+// and queued packets are written together in a single gathered write.
+// The handlers and callbacks run on the given strand; publish, subscribe,
+// unsubscribe, cork and uncork may be called from any thread and the
+// callbacks are never called with the internal lock held.
+class transport {
+   public:
+    using io_service = boost::asio::io_service;
+    using strand_type = io_service::strand;
+
+    struct callbacks {
+        std::function<void(int rc)> on_connect;
+        std::function<void(int rc)> on_disconnect;
+        std::function<void(int mid)> on_publish;
+        // the packet views the read buffer
+        std::function<void(publish_packet const& pub)> on_message;
+    };
+
+    // counts its socket operations on the metrics, takes the storage of
+    // its handlers from the allocator
+    transport(io_service& io, strand_type& strand, std::string client_id,
+              bool clean_session, callbacks cb, client_metrics& metrics,
+              std::shared_ptr<handler_allocator> allocator);
+    ~transport();
+
+    transport(transport const&) = delete;
+    transport& operator=(transport const&) = delete;
+
+    // must be called from the strand
+    void connect(std::string host, int port, int keep_alive);
+    void reconnect();
+
+    // return the message id; qos 0 publishes throw no_connection while not
+    // connected, qos 1 and 2 messages are kept and sent once connected;
+    // subscribes and unsubscribes are dropped while not connected, returning
+    // zero, the subscriptions being sent again on connection
+    int publish(string_view topic, string_view payload, int qos, bool retain);
+    int subscribe(string_view topic, int qos);
+    int unsubscribe(string_view topic);
+
+    // packets queued while corked are written on the last uncork
+    void cork();
+    void uncork();
+
+    // maximum number of packets gathered on each write
+    void set_write_budget(std::size_t packets);
+
+   private:
+    using error_code = boost::system::error_code;
+    using clock = std::chrono::steady_clock;
+    using data_type = std::shared_ptr<std::string>;
+
+    struct outgoing {
+        data_type data;
+        // qos 0 publishes complete once written
+        int completed_mid;
+        // qos 1 and 2 publishes are marked written in flight
+        int inflight_mid;
+    };
+
+    struct inflight {
+        data_type data;
+        int mid;
+        int qos;
+        // qos 2 messages already acknowledged by a pubrec
+        bool released;
+        // sent at least once, flagged as a duplicate when sent again
+        bool written;
+    };
+
+    // a view of the gathered buffers, cheap to copy into the write operation
+    struct buffer_sequence {
+        using value_type = boost::asio::const_buffer;
+        using const_iterator = value_type const*;
+        const_iterator begin() const { return first; }
+        const_iterator end() const { return last; }
+        const_iterator first;
+        const_iterator last;
+    };
+
+    void handle_resolve(error_code ec,
+                        boost::asio::ip::tcp::resolver::iterator it);
+    void handle_connect(error_code ec);
+
+    void await_read();
+    void handle_read(unsigned generation, error_code ec, std::size_t bytes);
+    // handles the complete packets of data, false once the connection is
+    // lost; used is set to the bytes of the packets handled
+    bool handle_packets(char const* data, std::size_t size,
+                        unsigned generation, std::size_t& used);
+    void handle_packet(packet const& p);
+    void handle_connack(packet const& p);
+    void handle_publish(packet const& p);
+
+    // the connection attempt fails once the connack takes longer than the
+    // keep alive period, or connack_timeout without keep alive
+    void await_connack();
+    void handle_connack_timeout(unsigned generation, error_code ec);
+
+    void await_keep_alive();
+    void handle_keep_alive(unsigned generation, error_code ec);
+
+    // require the lock to be held, return true when a write must be started
+    bool enqueue(data_type data, int completed_mid = 0, int inflight_mid = 0);
+    bool enqueue(std::string data);
+    int next_mid();
+
+    void post_write();
+    void start_write();
+    void handle_write(unsigned generation, error_code ec, std::size_t bytes);
+    // marks the messages in flight among the first bytes of the write
+    void mark_written(std::size_t bytes);
+
+    // reported as a failed connection attempt until the connack arrived
+    void connection_lost();
+
+    template <typename Handler>
+    allocating_handler<typename std::decay<Handler>::type> bind_allocator(
+        Handler&& handler) {
+        return make_allocating_handler(allocator_,
+                                       std::forward<Handler>(handler));
+    }
+
+    strand_type& strand_;
+    boost::asio::ip::tcp::resolver resolver_;
+    boost::asio::ip::tcp::socket socket_;
+    wheel_timer keep_alive_timer_;
+    callbacks callbacks_;
+    client_metrics& metrics_;
+    std::shared_ptr<handler_allocator> allocator_;
+
+    std::string client_id_;
+    bool clean_session_;
+    std::string host_;
+    int port_{0};
+    int keep_alive_{0};
+
+    // handlers of a previous socket are ignored after reconnecting
+    unsigned generation_{0};
+
+    // partial packets, decoded from [read_begin_, read_end_) once complete
+    std::vector<char> read_buffer_;
+    std::size_t read_begin_{0};
+    std::size_t read_end_{0};
+    clock::time_point last_busy_read_;
+    // qos 2 messages received and not released yet
+    std::unordered_set<int> incoming_;
+    bool ping_outstanding_{false};
+    clock::time_point last_write_;
+
+    std::mutex mutex_;
+    bool connected_{false};
+    boost::container::deque<outgoing> queue_;
+    // in the order they were published, which they are sent again in after
+    // reconnecting, indexed by message id for the acknowledgements
+    std::list<inflight> inflight_;
+    std::unordered_map<int, std::list<inflight>::iterator> inflight_index_;
+    std::uint16_t last_mid_{0};
+    std::size_t write_budget_{64};
+    unsigned corked_{0};
+    bool write_scheduled_{false};
+    bool writing_{false};
+    std::size_t writing_count_{0};
+    std::vector<boost::asio::const_buffer> gather_;
+    std::vector<int> completed_;
+};
+
+}  // namespace mqtt
+}  // namespace mosquittoasio
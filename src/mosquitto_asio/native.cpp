@@ -56,6 +56,16 @@ void set_user_data(handle_type* handle, void* user_data) noexcept {
     mosquitto_user_data_set(handle, user_data);
 }
 
+void set_threaded(handle_type* handle, bool threaded) {
+    auto rc = mosquitto_threaded_set(handle, threaded);
+    detail::throw_on_error(rc);
+}
+
+void set_max_inflight_messages(handle_type* handle, unsigned max_inflight) {
+    auto rc = mosquitto_max_inflight_messages_set(handle, max_inflight);
+    detail::throw_on_error(rc);
+}
+
 void set_connect_callback(handle_type* handle, connect_callback_type callback) noexcept {
     mosquitto_connect_callback_set(handle, callback);
 }
@@ -94,6 +104,16 @@ std::error_code reconnect(handle_type* handle) noexcept {
     return detail::make_error_code(ev);
 }
 
+std::error_code connect_async(handle_type* handle, char const* host, int port, int keepalive) noexcept {
+    auto ev = mosquitto_connect_async(handle, host, port, keepalive);
+    return detail::make_error_code(ev);
+}
+
+std::error_code reconnect_async(handle_type* handle) noexcept {
+    auto ev = mosquitto_reconnect_async(handle);
+    return detail::make_error_code(ev);
+}
+
 std::error_code disconnect(handle_type* handle) noexcept {
     auto ev = mosquitto_disconnect(handle);
     return detail::make_error_code(ev);
@@ -104,14 +124,14 @@ void publish(handle_type* handle, int* mid, char const* topic, int payloadlen, v
     detail::throw_on_error(rc);
 }
 
-void subscribe(handle_type* handle, int* mid, char const* sub, int qos) {
-    auto rc = mosquitto_subscribe(handle, mid, sub, qos);
-    detail::throw_on_error(rc);
+std::error_code subscribe(handle_type* handle, int* mid, char const* sub, int qos) noexcept {
+    auto ev = mosquitto_subscribe(handle, mid, sub, qos);
+    return detail::make_error_code(ev);
 }
 
-void unsubscribe(handle_type* handle, int* mid, char const* sub) {
-    auto rc = mosquitto_unsubscribe(handle, mid, sub);
-    detail::throw_on_error(rc);
+std::error_code unsubscribe(handle_type* handle, int* mid, char const* sub) noexcept {
+    auto ev = mosquitto_unsubscribe(handle, mid, sub);
+    return detail::make_error_code(ev);
 }
 
 std::error_code loop(handle_type* handle, int timeout, int max_packets) noexcept {
@@ -27,6 +27,8 @@ void destroy(handle_type* handle) noexcept;
 void set_tls(handle_type* handle, char const* cafile, char const* capath, char const* certfile, char const* keyfile, int (*pw_callback)(char* buf, int size, int rwflag, void* user_data));
 void set_tls_opts(handle_type* handle, int cert_reqs, char const* tls_version, char const* ciphers);
 void set_user_data(handle_type* handle, void* user_data) noexcept;
+void set_threaded(handle_type* handle, bool threaded);
+void set_max_inflight_messages(handle_type* handle, unsigned max_inflight);
 
 void set_connect_callback(handle_type* handle, connect_callback_type callback) noexcept;
 void set_disconnect_callback(handle_type* handle, disconnect_callback_type callback) noexcept;
@@ -38,11 +40,16 @@ void set_log_callback(handle_type* handle, log_callback_type callback) noexcept;
 
 std::error_code connect(handle_type* handle, char const* host, int port, int keepalive) noexcept;
 std::error_code reconnect(handle_type* handle) noexcept;
+// only start connecting, the socket is ready to be waited on and the
+// connection completes through loop_write and loop_read
+std::error_code connect_async(handle_type* handle, char const* host, int port, int keepalive) noexcept;
+std::error_code reconnect_async(handle_type* handle) noexcept;
 std::error_code disconnect(handle_type* handle) noexcept;
 
 void publish(handle_type* handle, int* mid, char const* topic, int payloadlen, void const* payload, int qos, bool retain);
-void subscribe(handle_type* handle, int* mid, char const* sub, int qos);
-void unsubscribe(handle_type* handle, int* mid, char const* sub);
+// no_connection while disconnected
+std::error_code subscribe(handle_type* handle, int* mid, char const* sub, int qos) noexcept;
+std::error_code unsubscribe(handle_type* handle, int* mid, char const* sub) noexcept;
 
 std::error_code loop(handle_type* handle, int timeout = -1, int max_packets = 1) noexcept;
 
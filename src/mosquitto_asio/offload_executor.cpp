@@ -0,0 +1,57 @@
+#include "offload_executor.hpp"
+
+#include <boost/functional/hash.hpp>
+
+#include <algorithm>
+
+namespace mosquittoasio {
+
+offload_executor::offload_executor(io_service& io, options o)
+    : options_(o), allocator_(std::make_shared<handler_allocator>()) {
+    auto lanes = std::max<std::size_t>(options_.lanes, 1);
+    lanes_.reserve(lanes);
+    for (std::size_t i = 0; i < lanes; ++i) {
+        lanes_.emplace_back(io);
+    }
+}
+
+std::size_t offload_executor::depth() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return queued_;
+}
+
+std::size_t offload_executor::topic_key(message const& msg) {
+    return boost::hash<message::string_view>{}(msg.topic());
+}
+
+bool offload_executor::acquire() {
+    std::unique_lock<std::mutex> lock{mutex_};
+    if (options_.max_queued && queued_ >= options_.max_queued) {
+        if (options_.policy == overflow_policy::drop_newest) {
+            lock.unlock();
+            metrics_.dropped.add();
+            return false;
+        }
+        space_.wait(lock, [this] { return queued_ < options_.max_queued; });
+    }
+    auto depth = ++queued_;
+    lock.unlock();
+
+    metrics_.submitted.add();
+    metrics_.queue_depth.record(depth);
+    return true;
+}
+
+void offload_executor::release() {
+    bool was_full;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        was_full = queued_-- == options_.max_queued;
+    }
+    if (was_full) {
+        space_.notify_all();
+    }
+    metrics_.completed.add();
+}
+
+}  // namespace mosquittoasio
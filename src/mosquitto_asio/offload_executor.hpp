@@ -0,0 +1,127 @@
+#pragma once
+
+#include "handler_allocator.hpp"
+#include "message.hpp"
+#include "metrics.hpp"
+
+#include <boost/asio.hpp>
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace mosquittoasio {
+
+struct offload_metrics {
+    metrics::counter submitted;
+    metrics::counter completed;
+    // refused since the queue was full
+    metrics::counter dropped;
+    // handlers queued, the new one included, on each submission
+    metrics::histogram queue_depth;
+    // from submitting a handler to running it
+    metrics::histogram queue_latency_ns;
+
+    template <typename Writer>
+    void visit(Writer& w) const {
+        w.add_counter("submitted", "Handlers submitted", submitted);
+        w.add_counter("completed", "Handlers completed", completed);
+        w.add_counter("dropped", "Handlers dropped by a full queue",
+                      dropped);
+        w.add_histogram("queue_depth", "Handlers queued on each submission",
+                        queue_depth);
+        w.add_histogram("queue_latency_ns",
+                        "Time from submitting a handler to running it",
+                        queue_latency_ns);
+    }
+};
+
+// Runs handlers on the threads of an io_service of their own, keeping the
+// order of the handlers sharing a key: keys are spread over a fixed number
+// of strands, the lanes, so the handlers of a key run one after the other
+// in submission order while other lanes run in parallel. At most
+// max_queued handlers are queued, a full queue blocks or drops the new
+// ones. Handlers may be submitted from any thread; the executor must
+// outlive the handlers it queued.
+class offload_executor {
+   public:
+    using io_service = boost::asio::io_service;
+    using key_function = std::function<std::size_t(message const&)>;
+
+    enum class overflow_policy { block, drop_newest };
+
+    struct options {
+        std::size_t lanes{16};
+        std::size_t max_queued{1024};
+        // blocking from a thread running io deadlocks once full
+        overflow_policy policy{overflow_policy::block};
+    };
+
+    offload_executor(io_service& io, options o);
+
+    offload_executor(offload_executor const&) = delete;
+    offload_executor& operator=(offload_executor const&) = delete;
+
+    // false when the queue was full and the handler dropped
+    template <typename Function>
+    bool post(std::size_t key, Function&& f);
+
+    // handlers queued and not completed yet
+    std::size_t depth() const;
+    offload_metrics const& metrics() const { return metrics_; }
+
+    // the default key, the topic of the message
+    static std::size_t topic_key(message const& msg);
+
+   private:
+    template <typename Function>
+    struct job {
+        offload_executor* executor;
+        metrics::clock::time_point since;
+        Function function;
+
+        void operator()();
+    };
+
+    // counts a submission, false when it must be dropped
+    bool acquire();
+    void release();
+
+    options const options_;
+    std::vector<io_service::strand> lanes_;
+    std::shared_ptr<handler_allocator> allocator_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable space_;
+    std::size_t queued_{0};
+
+    offload_metrics metrics_;
+};
+
+template <typename Function>
+bool offload_executor::post(std::size_t key, Function&& f) {
+    if (!acquire()) {
+        return false;
+    }
+    using job_type = job<typename std::decay<Function>::type>;
+    auto& lane = lanes_[key % lanes_.size()];
+    lane.post(make_allocating_handler(
+        allocator_,
+        job_type{this, metrics::clock::now(), std::forward<Function>(f)}));
+    return true;
+}
+
+template <typename Function>
+void offload_executor::job<Function>::operator()() {
+    executor->metrics_.queue_latency_ns.record(metrics::elapsed_ns(since));
+    // released even when the function throws
+    struct releaser {
+        ~releaser() { executor->release(); }
+        offload_executor* executor;
+    } r{executor};
+    function();
+}
+
+}  // namespace mosquittoasio
@@ -0,0 +1,85 @@
+#include "receiver.hpp"
+
+namespace mosquittoasio {
+
+receiver::~receiver() {
+    cancel();
+}
+
+receiver& receiver::operator=(receiver&& o) {
+    std::swap(state_, o.state_);
+    std::swap(subscription_, o.subscription_);
+    return *this;
+}
+
+bool receiver::try_receive(message& msg) {
+    if (!state_) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock{state_->mutex};
+    if (state_->queue.empty()) {
+        return false;
+    }
+    msg = std::move(state_->queue.front());
+    state_->queue.pop_front();
+    return true;
+}
+
+void receiver::cancel() {
+    if (!state_) {
+        return;
+    }
+    waiter* pending;
+    {
+        std::lock_guard<std::mutex> lock{state_->mutex};
+        pending = state_->pending;
+        state_->pending = nullptr;
+    }
+    if (pending) {
+        pending->complete(std::make_error_code(std::errc::operation_canceled),
+                          message{});
+    }
+}
+
+std::size_t receiver::size() const {
+    if (!state_) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock{state_->mutex};
+    return state_->queue.size();
+}
+
+std::uint64_t receiver::dropped() const {
+    if (!state_) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock{state_->mutex};
+    return state_->dropped;
+}
+
+receiver::receiver(std::shared_ptr<state> s, subscription sub)
+    : state_(std::move(s)), subscription_(std::move(sub)) {
+}
+
+receiver::state::~state() {
+    // the receiver cancels its wait first, one left here is dropped
+    if (pending) {
+        pending->destroy();
+    }
+}
+
+void receiver::state::push(message const& msg) {
+    std::unique_lock<std::mutex> lock{mutex};
+    if (auto w = pending) {
+        pending = nullptr;
+        lock.unlock();
+        w->complete(std::error_code{}, msg);
+        return;
+    }
+    if (queue.full()) {
+        ++dropped;
+    }
+    queue.push_back(msg);
+}
+
+}  // namespace mosquittoasio
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "completion.hpp"
+#include "error.hpp"
+#include "handler_allocator.hpp"
+#include "message.hpp"
+#include "subscription.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/circular_buffer.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+namespace mosquittoasio {
+
+class dispatcher;
+
+// The messages of a subscription queued for a consumer pulling them, made
+// by dispatcher::receive. Up to capacity messages are queued, a full queue
+// drops the oldest one. async_receive completes with (std::error_code,
+// message) through the executor associated with the token, the client
+// strand for a plain callback, and never from inside the call; a receive
+// completing from the queue waits for nothing, so a consumer takes the
+// first message with async_receive and the ones queued meanwhile with
+// try_receive. One receive may be pending at a time, another one fails
+// with operation_in_progress; cancel and the destructor complete the
+// pending one with operation_canceled. Thread safe.
+class receiver {
+   public:
+    receiver() = default;
+    ~receiver();
+
+    receiver(receiver&&) = default;
+    receiver& operator=(receiver&&);
+
+    template <typename CompletionToken>
+    auto async_receive(CompletionToken&& token)
+        -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken,
+                                         void(std::error_code, message));
+
+    // takes the oldest queued message, false when empty
+    bool try_receive(message& msg);
+
+    void cancel();
+
+    // messages queued, and dropped since the queue was full
+    std::size_t size() const;
+    std::uint64_t dropped() const;
+
+   private:
+    friend class dispatcher;
+
+    using strand_type = boost::asio::io_service::strand;
+
+    struct state;
+
+    // a pending receive, type erased once per wait rather than per message
+    // and stored by the allocator of the state, which recycles it; complete
+    // and destroy free the waiter
+    struct waiter {
+        virtual void complete(std::error_code ec, message msg) = 0;
+        virtual void destroy() = 0;
+
+       protected:
+        ~waiter() = default;
+    };
+
+    template <typename Handler>
+    struct waiter_impl final : waiter {
+        waiter_impl(Handler h, state& s) : handler(std::move(h)), owner(s) {}
+
+        void complete(std::error_code ec, message msg) override {
+            auto h = std::move(handler);
+            auto& s = owner;
+            // freed before the completion, which may wait again
+            destroy();
+            post_completion(s.strand, std::move(h), ec, std::move(msg));
+        }
+
+        void destroy() override {
+            auto& allocator = owner.allocator;
+            this->~waiter_impl();
+            allocator.deallocate(this, sizeof(waiter_impl));
+        }
+
+        Handler handler;
+        state& owner;
+    };
+
+    // shared with the subscription slot
+    struct state {
+        state(strand_type const& s, std::size_t capacity)
+            : strand(s), queue(capacity ? capacity : 1) {}
+        ~state();
+
+        void push(message const& msg);
+
+        strand_type strand;
+        handler_allocator allocator;
+        mutable std::mutex mutex;
+        boost::circular_buffer<message> queue;
+        std::uint64_t dropped{0};
+        waiter* pending{nullptr};
+    };
+
+    struct initiate_receive {
+        state* s;
+
+        template <typename Handler>
+        void operator()(Handler&& handler) const;
+    };
+
+    receiver(std::shared_ptr<state> s, subscription sub);
+
+    std::shared_ptr<state> state_;
+    // unsubscribes first, the state outlives the slot
+    subscription subscription_;
+};
+
+template <typename CompletionToken>
+auto receiver::async_receive(CompletionToken&& token)
+    -> BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken,
+                                     void(std::error_code, message)) {
+    if (!state_) {
+        throw std::system_error{make_error_code(errc::invalid_parameters)};
+    }
+    return boost::asio::async_initiate<CompletionToken,
+                                       void(std::error_code, message)>(
+        initiate_receive{state_.get()}, token);
+}
+
+template <typename Handler>
+void receiver::initiate_receive::operator()(Handler&& handler) const {
+    using handler_type = typename std::decay<Handler>::type;
+    std::unique_lock<std::mutex> lock{s->mutex};
+    if (!s->queue.empty()) {
+        auto msg = std::move(s->queue.front());
+        s->queue.pop_front();
+        lock.unlock();
+        post_completion(s->strand, std::forward<Handler>(handler),
+                        std::error_code{}, std::move(msg));
+        return;
+    }
+    if (s->pending) {
+        lock.unlock();
+        post_completion(s->strand, std::forward<Handler>(handler),
+                        std::make_error_code(std::errc::operation_in_progress),
+                        message{});
+        return;
+    }
+    auto storage = s->allocator.allocate(sizeof(waiter_impl<handler_type>));
+    s->pending =
+        new (storage) waiter_impl<handler_type>{std::forward<Handler>(handler), *s};
+}
+
+}  // namespace mosquittoasio
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <boost/signals2.hpp>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+namespace mosquittoasio {
+namespace lightweight {
+
+// A non thread safe alternative to boost::signals2, slots live in an
+// intrusive list owned by the signal, connecting allocates the slot once and
+// emitting neither locks nor allocates.
+// Slots disconnected while emitting are unlinked once the emission ends,
+// slots connected while emitting are only called on the next emission.
+
+class connection;
+
+namespace detail {
+
+class signal_base;
+
+struct slot_base {
+    virtual ~slot_base() = default;
+
+    slot_base* prev{nullptr};
+    slot_base* next{nullptr};
+    signal_base* owner{nullptr};
+    bool connected{true};
+
+    // the slot owns itself while linked, connections only observe it
+    std::shared_ptr<slot_base> self;
+};
+
+class signal_base {
+   public:
+    signal_base() = default;
+
+    signal_base(signal_base const&) = delete;
+    signal_base& operator=(signal_base const&) = delete;
+
+    signal_base(signal_base&& o) noexcept
+        : head_(o.head_), tail_(o.tail_), size_(o.size_) {
+        o.head_ = o.tail_ = nullptr;
+        o.size_ = 0;
+        for (auto s = head_; s; s = s->next) {
+            s->owner = this;
+        }
+    }
+    signal_base& operator=(signal_base&&) = delete;
+
+    ~signal_base() {
+        auto s = head_;
+        while (s) {
+            auto next = s->next;
+            s->connected = false;
+            s->owner = nullptr;
+            s->self.reset();
+            s = next;
+        }
+    }
+
+    bool empty() const { return size_ == 0; }
+    std::size_t num_slots() const { return size_; }
+
+    void disconnect(slot_base* s) {
+        if (!s->connected) {
+            return;
+        }
+        s->connected = false;
+        --size_;
+        if (emitting_) {
+            dirty_ = true;
+            return;
+        }
+        unlink(s);
+    }
+
+   protected:
+    connection link(std::shared_ptr<slot_base> s);
+
+    void begin_emit() { ++emitting_; }
+    void end_emit() {
+        if (--emitting_ || !dirty_) {
+            return;
+        }
+        dirty_ = false;
+        auto s = head_;
+        while (s) {
+            auto next = s->next;
+            if (!s->connected) {
+                unlink(s);
+            }
+            s = next;
+        }
+    }
+
+    slot_base* head_{nullptr};
+    slot_base* tail_{nullptr};
+
+   private:
+    void unlink(slot_base* s) {
+        (s->prev ? s->prev->next : head_) = s->next;
+        (s->next ? s->next->prev : tail_) = s->prev;
+        s->owner = nullptr;
+        auto self = std::move(s->self);
+    }
+
+    std::size_t size_{0};
+    unsigned emitting_{0};
+    bool dirty_{false};
+};
+
+}  // namespace detail
+
+class connection {
+   public:
+    connection() = default;
+
+    void disconnect() const {
+        auto s = slot_.lock();
+        if (s && s->owner) {
+            s->owner->disconnect(s.get());
+        }
+    }
+
+    bool connected() const {
+        auto s = slot_.lock();
+        return s && s->connected;
+    }
+
+   private:
+    friend class detail::signal_base;
+
+    explicit connection(std::weak_ptr<detail::slot_base> s)
+        : slot_(std::move(s)) {}
+
+    std::weak_ptr<detail::slot_base> slot_;
+};
+
+class scoped_connection : public connection {
+   public:
+    scoped_connection() = default;
+    scoped_connection(connection const& c) : connection(c) {}
+    ~scoped_connection() { disconnect(); }
+
+    scoped_connection(scoped_connection const&) = delete;
+    scoped_connection& operator=(scoped_connection const&) = delete;
+
+    scoped_connection(scoped_connection&&) = default;
+    scoped_connection& operator=(scoped_connection&& o) {
+        if (this != &o) {
+            disconnect();
+            connection::operator=(std::move(o));
+        }
+        return *this;
+    }
+};
+
+inline connection detail::signal_base::link(std::shared_ptr<slot_base> s) {
+    auto raw = s.get();
+    raw->owner = this;
+    raw->prev = tail_;
+    (tail_ ? tail_->next : head_) = raw;
+    tail_ = raw;
+    ++size_;
+    raw->self = s;
+    return connection{std::move(s)};
+}
+
+template <typename Signature>
+class signal;
+
+template <typename... Args>
+class signal<void(Args...)> : public detail::signal_base {
+   public:
+    using slot_type = std::function<void(Args...)>;
+
+    template <typename Function>
+    connection connect(Function&& f) {
+        auto s = std::make_shared<slot>(std::forward<Function>(f));
+        return link(std::move(s));
+    }
+
+    void operator()(Args... args) {
+        // slots appended during the emission are left for the next one
+        auto last = tail_;
+        if (!last) {
+            return;
+        }
+        begin_emit();
+        try {
+            for (auto s = head_;; s = s->next) {
+                if (s->connected) {
+                    static_cast<slot*>(s)->function(args...);
+                }
+                if (s == last) {
+                    break;
+                }
+            }
+        } catch (...) {
+            end_emit();
+            throw;
+        }
+        end_emit();
+    }
+
+   private:
+    struct slot : detail::slot_base {
+        template <typename Function>
+        explicit slot(Function&& f) : function(std::forward<Function>(f)) {}
+
+        slot_type function;
+    };
+};
+
+}  // namespace lightweight
+
+#if MOSQUITTOASIO_LIGHTWEIGHT_SIGNALS
+template <typename Signature>
+using signal = lightweight::signal<Signature>;
+using connection = lightweight::connection;
+using scoped_connection = lightweight::scoped_connection;
+#else
+template <typename Signature>
+using signal = boost::signals2::signal<Signature>;
+using connection = boost::signals2::connection;
+using scoped_connection = boost::signals2::scoped_connection;
+#endif
+
+// A signal only allocated by its first connection, emitting a signal never
+// connected to is a pointer check; objects carrying many signals seldom
+// connected to, as clients do, stay small. Connecting is as thread safe as
+// the underlying signal.
+template <typename Signature>
+class lazy_signal;
+
+template <typename... Args>
+class lazy_signal<void(Args...)> {
+   public:
+    using signal_type = signal<void(Args...)>;
+
+    lazy_signal() = default;
+    ~lazy_signal() { delete signal_.load(std::memory_order_relaxed); }
+
+    lazy_signal(lazy_signal const&) = delete;
+    lazy_signal& operator=(lazy_signal const&) = delete;
+
+    template <typename... Slot>
+    connection connect(Slot&&... slot) {
+        return get().connect(std::forward<Slot>(slot)...);
+    }
+
+    template <typename... Values>
+    void operator()(Values&&... values) {
+        if (auto s = signal_.load(std::memory_order_acquire)) {
+            (*s)(std::forward<Values>(values)...);
+        }
+    }
+
+    bool empty() const {
+        auto s = signal_.load(std::memory_order_acquire);
+        return !s || s->empty();
+    }
+    std::size_t num_slots() const {
+        auto s = signal_.load(std::memory_order_acquire);
+        return s ? s->num_slots() : 0;
+    }
+
+   private:
+    signal_type& get() {
+        if (auto s = signal_.load(std::memory_order_acquire)) {
+            return *s;
+        }
+        // concurrent first connections race to install theirs
+        std::unique_ptr<signal_type> fresh{new signal_type};
+        signal_type* current = nullptr;
+        if (signal_.compare_exchange_strong(current, fresh.get(),
+                                            std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+            return *fresh.release();
+        }
+        return *current;
+    }
+
+    std::atomic<signal_type*> signal_{nullptr};
+};
+
+}  // namespace mosquittoasio
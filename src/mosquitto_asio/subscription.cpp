@@ -12,17 +12,16 @@ namespace mosquittoasio {
 
 subscription::~subscription() {
     connection_.disconnect();
-    if (dispatcher_ && topic_) {
-        dispatcher_->unsubscribe(*topic_);
+    if (dispatcher_) {
+        dispatcher_->unsubscribe(topic_);
     }
 }
 
 subscription::subscription(subscription&& o)
     : dispatcher_(o.dispatcher_),
-      topic_(o.topic_),
-      connection_(std::move(connection_)) {
+      topic_(std::move(o.topic_)),
+      connection_(std::move(o.connection_)) {
     o.dispatcher_ = nullptr;
-    o.topic_ = nullptr;
 }
 
 subscription& subscription::operator=(subscription&& o) {
@@ -33,7 +32,7 @@ subscription& subscription::operator=(subscription&& o) {
 }
 
 subscription::subscription(dispatcher& d, std::string const& t, connection&& c)
-    : dispatcher_(&d), topic_(&t), connection_(std::move(c)) {
+    : dispatcher_(&d), topic_(t), connection_(std::move(c)) {
 }
 
 }  // namespace mosquittoasio
@@ -1,6 +1,8 @@
 #pragma once
 
-#include <boost/signals2.hpp>
+#include "signal.hpp"
+
+#include <string>
 
 namespace mosquittoasio {
 
@@ -19,16 +21,15 @@ class subscription {
     ~subscription();
 
    private:
-    using connection = boost::signals2::connection;
-
     // only a dispatcher can create a active subscription
     friend class dispatcher;
 
     subscription(dispatcher&, std::string const&, connection&&);
 
     dispatcher* dispatcher_{nullptr};
-    std::string const* topic_{nullptr};
-    boost::signals2::connection connection_;
+    // a copy, the entry may be erased on the strand meanwhile
+    std::string topic_;
+    connection connection_;
 };
 
 }  // namespace mosquittoasio
@@ -0,0 +1,351 @@
+#include "timer_wheel.hpp"
+
+#include <algorithm>
+
+namespace mosquittoasio {
+
+constexpr std::size_t timer_wheel::slot_bits;
+constexpr std::size_t timer_wheel::slots;
+constexpr std::size_t timer_wheel::levels;
+constexpr std::uint64_t timer_wheel::never;
+
+boost::asio::io_service::id timer_wheel::id;
+
+timer_wheel::timer_wheel(boost::asio::io_service& io)
+    : boost::asio::io_service::service(io),
+      io_(io),
+      wakeup_(io),
+      allocator_(std::make_shared<handler_allocator>()),
+      epoch_(clock::now()) {}
+
+std::size_t timer_wheel::size() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return size_;
+}
+
+std::uint64_t timer_wheel::wakeups() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return wakeups_;
+}
+
+void timer_wheel::shutdown() {
+    // the pending handlers are destroyed without being called, as asio
+    // does with its own on shutdown, once the lock is released since they
+    // may own timers
+    waits dropped;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto drop = [&dropped](wheel_timer* t) {
+            while (t) {
+                auto next = t->next_;
+                t->prev_ = t->next_ = nullptr;
+                t->linked_ = false;
+                t->pending_ = false;
+                dropped.push(t->wait_, {});
+                t->wait_ = nullptr;
+                t = next;
+            }
+        };
+        for (auto& level : slots_) {
+            for (auto& slot : level) {
+                drop(slot);
+                slot = nullptr;
+            }
+        }
+        drop(overflow_);
+        overflow_ = nullptr;
+        occupied_.fill(0);
+        size_ = 0;
+        while (ready_.first) {
+            dropped.push(ready_.pop(), {});
+        }
+
+        error_code ec;
+        wakeup_.cancel(ec);
+    }
+    while (dropped.first) {
+        dropped.pop()->destroy();
+    }
+}
+
+std::uint64_t timer_wheel::to_tick(clock::time_point t) const {
+    if (t <= epoch_) {
+        return 0;
+    }
+    // rounded up, a timer never expires early
+    auto d = t - epoch_;
+    auto ticks = std::chrono::duration_cast<tick>(d);
+    if (ticks < d) {
+        ++ticks;
+    }
+    return static_cast<std::uint64_t>(ticks.count());
+}
+
+void timer_wheel::add(wheel_timer& t, waits& due) {
+    t.tick_ = to_tick(t.expiry_);
+    ++size_;
+    place(t, due);
+    if (t.linked_) {
+        arm(t.tick_);
+    }
+}
+
+void timer_wheel::remove(wheel_timer& t) {
+    unlink(t);
+    // a wake up left pending would keep the io_service running
+    if (!--size_ && armed_ != never) {
+        armed_ = never;
+        error_code ec;
+        wakeup_.cancel(ec);
+    }
+}
+
+void timer_wheel::place(wheel_timer& t, waits& due) {
+    if (t.tick_ <= now_) {
+        due.push(t.wait_, {});
+        t.wait_ = nullptr;
+        t.pending_.store(false, std::memory_order_relaxed);
+        --size_;
+        return;
+    }
+
+    // the level is picked by the highest bits differing from the wheel
+    // time, so the timer is moved down a level whenever the wheel reaches
+    // its slot and expires once reached on the first level
+    auto level = static_cast<std::size_t>(63 - __builtin_clzll(t.tick_ ^ now_)) /
+                 slot_bits;
+    wheel_timer** head = &overflow_;
+    if (level < levels) {
+        auto slot = static_cast<std::size_t>(t.tick_ >> (level * slot_bits)) &
+                    (slots - 1);
+        head = &slots_[level][slot];
+        occupied_[level] |= std::uint64_t{1} << slot;
+        t.slot_ = slot;
+    } else {
+        level = levels;
+    }
+    t.level_ = level;
+
+    t.prev_ = nullptr;
+    t.next_ = *head;
+    if (*head) {
+        (*head)->prev_ = &t;
+    }
+    *head = &t;
+    t.linked_ = true;
+}
+
+void timer_wheel::place_all(wheel_timer* list, waits& due) {
+    while (list) {
+        auto next = list->next_;
+        list->prev_ = list->next_ = nullptr;
+        list->linked_ = false;
+        place(*list, due);
+        list = next;
+    }
+}
+
+void timer_wheel::unlink(wheel_timer& t) {
+    auto& head = t.level_ == levels ? overflow_ : slots_[t.level_][t.slot_];
+    if (t.prev_) {
+        t.prev_->next_ = t.next_;
+    } else {
+        head = t.next_;
+    }
+    if (t.next_) {
+        t.next_->prev_ = t.prev_;
+    }
+    if (!head && t.level_ < levels) {
+        occupied_[t.level_] &= ~(std::uint64_t{1} << t.slot_);
+    }
+    t.prev_ = t.next_ = nullptr;
+    t.linked_ = false;
+}
+
+std::uint64_t timer_wheel::next_event() const {
+    // the start of the first non empty slot of each level, every slot
+    // before the wheel time on its level being empty
+    auto next = never;
+    for (std::size_t level = 0; level < levels; ++level) {
+        if (!occupied_[level]) {
+            continue;
+        }
+        auto shift = level * slot_bits;
+        auto slot = static_cast<std::uint64_t>(__builtin_ctzll(occupied_[level]));
+        auto turn = now_ >> (shift + slot_bits) << (shift + slot_bits);
+        next = std::min(next, turn | (slot << shift));
+    }
+    if (overflow_) {
+        auto span = levels * slot_bits;
+        next = std::min(next, ((now_ >> span) + 1) << span);
+    }
+    return next;
+}
+
+void timer_wheel::advance(std::uint64_t to, waits& due) {
+    for (;;) {
+        auto next = next_event();
+        if (next > to) {
+            now_ = std::max(now_, to);
+            return;
+        }
+        now_ = next;
+
+        auto span = levels * slot_bits;
+        if (overflow_ && !(now_ & ((std::uint64_t{1} << span) - 1))) {
+            auto list = overflow_;
+            overflow_ = nullptr;
+            place_all(list, due);
+        }
+        // from the top, timers moved down may land on a slot reached too
+        for (auto level = levels; level-- > 0;) {
+            auto shift = level * slot_bits;
+            if (now_ & ((std::uint64_t{1} << shift) - 1)) {
+                continue;
+            }
+            auto slot = static_cast<std::size_t>(now_ >> shift) & (slots - 1);
+            auto list = slots_[level][slot];
+            if (!list) {
+                continue;
+            }
+            slots_[level][slot] = nullptr;
+            occupied_[level] &= ~(std::uint64_t{1} << slot);
+            place_all(list, due);
+        }
+    }
+}
+
+void timer_wheel::arm(std::uint64_t at) {
+    if (at >= armed_) {
+        return;
+    }
+    armed_ = at;
+    wakeup_.expires_at(epoch_ + tick(static_cast<tick::rep>(at)));
+    wakeup_.async_wait(make_allocating_handler(
+        allocator_, [this](error_code ec) { handle_wakeup(ec); }));
+}
+
+bool timer_wheel::queue(wait_type* w, error_code ec) {
+    ready_.push(w, ec);
+    if (flushing_) {
+        return false;
+    }
+    flushing_ = true;
+    return true;
+}
+
+void timer_wheel::handle_wakeup(error_code ec) {
+    if (ec == boost::asio::error::operation_aborted) {
+        return;
+    }
+    waits due;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        ++wakeups_;
+        armed_ = never;
+        auto now = std::chrono::duration_cast<tick>(clock::now() - epoch_);
+        advance(static_cast<std::uint64_t>(now.count()), due);
+        arm(next_event());
+    }
+    // already on the io_service, the handlers are called right away
+    complete(due);
+}
+
+void timer_wheel::post_flush() {
+    io_.post(make_allocating_handler(allocator_, [this] { flush(); }));
+}
+
+void timer_wheel::flush() {
+    waits ready;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        std::swap(ready, ready_);
+        flushing_ = false;
+    }
+    complete(ready);
+}
+
+void timer_wheel::complete(waits& w) {
+    while (w.first) {
+        auto wait = w.pop();
+        try {
+            wait->complete(wait->result);
+        } catch (...) {
+            auto start = false;
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                while (w.first) {
+                    auto left = w.pop();
+                    start = queue(left, left->result) || start;
+                }
+            }
+            if (start) {
+                post_flush();
+            }
+            throw;
+        }
+    }
+}
+
+wheel_timer::wheel_timer(boost::asio::io_service& io)
+    : wheel_(boost::asio::use_service<timer_wheel>(io)) {}
+
+wheel_timer::~wheel_timer() {
+    cancel();
+}
+
+std::size_t wheel_timer::expires_at(clock::time_point t) {
+    auto cancelled = cancel();
+    expiry_ = t;
+    return cancelled;
+}
+
+void wheel_timer::start_wait(detail::wheel_wait* wait) {
+    // the previous wait is aborted under the same lock
+    timer_wheel::waits due;
+    auto flush = false;
+    {
+        std::lock_guard<std::mutex> lock{wheel_.mutex_};
+        if (linked_) {
+            // the wake up stays armed, the wait is added right away
+            wheel_.unlink(*this);
+            --wheel_.size_;
+            flush = wheel_.queue(wait_, boost::asio::error::operation_aborted);
+        }
+        wait_ = wait;
+        pending_.store(true, std::memory_order_relaxed);
+        wheel_.add(*this, due);
+        // a deadline already passed completes as an aborted wait does
+        if (due.first) {
+            flush = wheel_.queue(due.pop(), {}) || flush;
+        }
+    }
+    if (flush) {
+        wheel_.post_flush();
+    }
+}
+
+std::size_t wheel_timer::cancel() {
+    // the wheel only ever clears it, a timer with no wait pending has
+    // nothing to cancel whatever the wheel does meanwhile
+    if (!pending_.load(std::memory_order_relaxed)) {
+        return 0;
+    }
+    auto flush = false;
+    {
+        std::lock_guard<std::mutex> lock{wheel_.mutex_};
+        if (!linked_) {
+            return 0;
+        }
+        wheel_.remove(*this);
+        flush = wheel_.queue(wait_, boost::asio::error::operation_aborted);
+        wait_ = nullptr;
+        pending_.store(false, std::memory_order_relaxed);
+    }
+    if (flush) {
+        wheel_.post_flush();
+    }
+    return 1;
+}
+
+}  // namespace mosquittoasio
@@ -0,0 +1,240 @@
+#pragma once
+
+#include "handler_allocator.hpp"
+
+#include <boost/asio.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace mosquittoasio {
+
+class wheel_timer;
+
+namespace detail {
+
+// A pending wait of a wheel_timer. Its handler is stored along with it in
+// storage taken through the allocation hooks of the handler, as asio does
+// for its own operations.
+class wheel_wait {
+   public:
+    using error_code = boost::system::error_code;
+
+    // frees the wait, then calls the handler with ec
+    virtual void complete(error_code ec) = 0;
+    // frees the wait without calling the handler
+    virtual void destroy() = 0;
+
+    // chains the waits the wheel completes together, with their result
+    wheel_wait* next{nullptr};
+    error_code result;
+
+   protected:
+    wheel_wait() = default;
+    ~wheel_wait() = default;
+};
+
+template <typename Handler>
+class wheel_wait_op final : public wheel_wait {
+   public:
+    static wheel_wait* create(Handler& handler) {
+        auto p = boost_asio_handler_alloc_helpers::allocate(
+            sizeof(wheel_wait_op), handler);
+        return new (p) wheel_wait_op{std::move(handler)};
+    }
+
+    void complete(error_code ec) override {
+        // the storage goes back before the call, ready for the next wait
+        Handler handler{std::move(handler_)};
+        free(handler);
+        handler(ec);
+    }
+
+    void destroy() override {
+        Handler handler{std::move(handler_)};
+        free(handler);
+    }
+
+   private:
+    explicit wheel_wait_op(Handler handler) : handler_(std::move(handler)) {}
+
+    void free(Handler& handler) {
+        this->~wheel_wait_op();
+        boost_asio_handler_alloc_helpers::deallocate(
+            this, sizeof(wheel_wait_op), handler);
+    }
+
+    Handler handler_;
+};
+
+}  // namespace detail
+
+// A hierarchical timer wheel shared by every wheel_timer of an io_service.
+// Timers are kept in 5 levels of 64 slots, 1 ms wide on the first level and
+// 64 times wider on each next one, so arming or cancelling one is a few
+// list operations whatever the number of timers. A single asio timer wakes
+// the wheel on its next due slot only: idle timers cost nothing between
+// their deadlines, and time jumps straight over empty slots.
+// Expirations are rounded up to the millisecond. The handlers of the expired
+// waits are called from the wake up of the wheel, those of the aborted ones
+// from a work posted once for all the waits aborted meanwhile, never from
+// inside async_wait, expires_at or cancel. Thread safe, a single lock
+// guards the wheel, only taken by the timers having a wait pending or
+// starting one.
+class timer_wheel : public boost::asio::io_service::service {
+   public:
+    using clock = std::chrono::steady_clock;
+    using tick = std::chrono::milliseconds;
+
+    static constexpr std::size_t slot_bits = 6;
+    static constexpr std::size_t slots = std::size_t{1} << slot_bits;
+    static constexpr std::size_t levels = 5;
+
+    static boost::asio::io_service::id id;
+
+    explicit timer_wheel(boost::asio::io_service& io);
+
+    // timers currently armed
+    std::size_t size() const;
+    // times the wheel woke up to expire or move timers
+    std::uint64_t wakeups() const;
+
+   private:
+    friend class wheel_timer;
+    using error_code = boost::system::error_code;
+    using wait_type = detail::wheel_wait;
+
+    // waits to complete, chained in order through their next member
+    struct waits {
+        void push(wait_type* w, error_code ec) {
+            w->result = ec;
+            w->next = nullptr;
+            if (last) {
+                last->next = w;
+            } else {
+                first = w;
+            }
+            last = w;
+        }
+        wait_type* pop() {
+            auto w = first;
+            first = w->next;
+            if (!first) {
+                last = nullptr;
+            }
+            return w;
+        }
+        wait_type* first{nullptr};
+        wait_type* last{nullptr};
+    };
+
+    static constexpr std::uint64_t never =
+        std::numeric_limits<std::uint64_t>::max();
+
+    void shutdown() override;
+
+    std::uint64_t to_tick(clock::time_point t) const;
+
+    // require the lock to be held
+    void add(wheel_timer& t, waits& due);
+    void remove(wheel_timer& t);
+    void place(wheel_timer& t, waits& due);
+    void place_all(wheel_timer* list, waits& due);
+    void unlink(wheel_timer& t);
+    std::uint64_t next_event() const;
+    void advance(std::uint64_t to, waits& due);
+    void arm(std::uint64_t at);
+    // adds to the waits of the next flush, true when it must be posted
+    bool queue(wait_type* w, error_code ec);
+
+    void handle_wakeup(error_code ec);
+    void post_flush();
+    void flush();
+    // the waits left when a handler throws are completed by a flush
+    void complete(waits& w);
+
+    boost::asio::io_service& io_;
+    mutable std::mutex mutex_;
+    boost::asio::steady_timer wakeup_;
+    std::shared_ptr<handler_allocator> allocator_;
+    clock::time_point epoch_;
+    // the wheel time, in ticks since epoch_; every timer linked expires
+    // after it
+    std::uint64_t now_{0};
+    std::uint64_t armed_{never};
+    std::uint64_t wakeups_{0};
+    std::size_t size_{0};
+    // completed by the next flush, already posted when flushing_ is set
+    waits ready_;
+    bool flushing_{false};
+
+    std::array<std::array<wheel_timer*, slots>, levels> slots_{};
+    // a bit set by non empty slot, on each level
+    std::array<std::uint64_t, levels> occupied_{};
+    // timers beyond the last level, placed again whenever it wraps
+    wheel_timer* overflow_{nullptr};
+};
+
+// A one shot timer on the timer_wheel of its io_service, used as an
+// asio deadline timer restricted to a single pending wait: arming it again
+// or waiting again cancels the previous wait, whose handler is called with
+// operation_aborted. The handler storage comes from its allocation hooks.
+class wheel_timer {
+   public:
+    using clock = timer_wheel::clock;
+    using error_code = boost::system::error_code;
+
+    explicit wheel_timer(boost::asio::io_service& io);
+    ~wheel_timer();
+
+    wheel_timer(wheel_timer const&) = delete;
+    wheel_timer& operator=(wheel_timer const&) = delete;
+
+    // return the number of waits cancelled, zero or one
+    std::size_t expires_at(clock::time_point t);
+    std::size_t expires_from_now(clock::duration d) {
+        return expires_at(clock::now() + d);
+    }
+    clock::time_point expiry() const { return expiry_; }
+
+    // the handler is called with (error_code)
+    template <typename WaitHandler>
+    void async_wait(WaitHandler&& handler) {
+        using op = detail::wheel_wait_op<typename std::decay<WaitHandler>::type>;
+        typename std::decay<WaitHandler>::type h(
+            std::forward<WaitHandler>(handler));
+        start_wait(op::create(h));
+    }
+
+    std::size_t cancel();
+
+   private:
+    friend class timer_wheel;
+
+    void start_wait(detail::wheel_wait* wait);
+
+    timer_wheel& wheel_;
+    clock::time_point expiry_;
+    detail::wheel_wait* wait_{nullptr};
+    // whether a wait is pending, read without the lock by its owner
+    std::atomic<bool> pending_{false};
+
+    // the wheel position, only touched with the wheel lock held
+    wheel_timer* prev_{nullptr};
+    wheel_timer* next_{nullptr};
+    std::uint64_t tick_{0};
+    std::size_t level_{0};
+    std::size_t slot_{0};
+    bool linked_{false};
+};
+
+}  // namespace mosquittoasio
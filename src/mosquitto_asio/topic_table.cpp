@@ -0,0 +1,37 @@
+#include "topic_table.hpp"
+
+namespace mosquittoasio {
+
+topic_id topic_table::intern(string_view topic) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it = ids_.find(topic);
+    if (it != ids_.end()) {
+        return it->second;
+    }
+    if (names_.size() >= max_topics_) {
+        return invalid_topic_id;
+    }
+
+    auto id = static_cast<topic_id>(names_.size());
+    names_.emplace_back(topic.data(), topic.size());
+    ids_.emplace(names_.back(), id);
+    return id;
+}
+
+topic_id topic_table::find(string_view topic) const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it = ids_.find(topic);
+    return it != ids_.end() ? it->second : invalid_topic_id;
+}
+
+auto topic_table::name(topic_id id) const -> string_view {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return id < names_.size() ? string_view{names_[id]} : string_view{};
+}
+
+std::size_t topic_table::size() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return names_.size();
+}
+
+}  // namespace mosquittoasio
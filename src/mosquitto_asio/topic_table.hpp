@@ -0,0 +1,51 @@
+#pragma once
+
+#include <boost/functional/hash.hpp>
+#include <boost/utility/string_view.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace mosquittoasio {
+
+using topic_id = std::uint32_t;
+constexpr topic_id invalid_topic_id = std::numeric_limits<topic_id>::max();
+
+// Interns topics and filters into dense ids, starting at zero, so per topic
+// state can live in arrays indexed by id instead of maps keyed by string.
+// Interned names are never released and their views stay valid for the
+// lifetime of the table; once max_topics are interned no new ids are given.
+class topic_table {
+   public:
+    using string_view = boost::string_view;
+
+    explicit topic_table(std::size_t max_topics) : max_topics_(max_topics) {}
+
+    topic_table(topic_table const&) = delete;
+    topic_table& operator=(topic_table const&) = delete;
+
+    // returns invalid_topic_id if the table is full
+    topic_id intern(string_view topic);
+    // returns invalid_topic_id if the topic was never interned
+    topic_id find(string_view topic) const;
+
+    // the view is null terminated
+    string_view name(topic_id id) const;
+
+    std::size_t size() const;
+    std::size_t max_size() const { return max_topics_; }
+
+   private:
+    std::size_t const max_topics_;
+
+    mutable std::mutex mutex_;
+    // a deque keeps the names in place as it grows, the keys view them
+    std::deque<std::string> names_;
+    std::unordered_map<string_view, topic_id, boost::hash<string_view>> ids_;
+};
+
+}  // namespace mosquittoasio
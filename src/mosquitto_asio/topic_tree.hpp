@@ -0,0 +1,248 @@
+#pragma once
+
+#include <boost/functional/hash.hpp>
+#include <boost/utility/string_view.hpp>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace mosquittoasio {
+
+// whether the filter matches the concrete topic, following the same rules
+// as topic_tree::match
+inline bool topic_matches(boost::string_view filter, boost::string_view topic) {
+    using string_view = boost::string_view;
+
+    // topics starting with '$' are not matched by a leading wildcard
+    if (!topic.empty() && topic.front() == '$' && !filter.empty() &&
+        (filter.front() == '+' || filter.front() == '#')) {
+        return false;
+    }
+
+    while (true) {
+        auto filter_end = filter.find('/');
+        auto filter_level = filter.substr(0, filter_end);
+        if (filter_level == "#") {
+            return true;
+        }
+
+        auto topic_end = topic.find('/');
+        if (filter_level != "+" &&
+            filter_level != topic.substr(0, topic_end)) {
+            return false;
+        }
+
+        if (topic_end == string_view::npos) {
+            // '#' also matches the parent level
+            return filter_end == string_view::npos ||
+                   filter.substr(filter_end + 1) == "#";
+        }
+        if (filter_end == string_view::npos) {
+            return false;
+        }
+        filter.remove_prefix(filter_end + 1);
+        topic.remove_prefix(topic_end + 1);
+    }
+}
+
+// Index of topic filters split by topic level, matching a topic visits only
+// the exact, '+' and '#' branches of each level so its cost depends on the
+// topic depth and not on the number of filters
+template <typename Value>
+class topic_tree {
+   public:
+    using string_view = boost::string_view;
+
+    // returns false if the filter already holds a value
+    bool insert(string_view filter, Value value);
+    // returns false if the filter holds no value
+    bool erase(string_view filter);
+
+    // calls f(Value const&) for every filter matching the topic
+    template <typename Function>
+    void match(string_view topic, Function&& f) const;
+
+    bool empty() const { return !root_.has_children(); }
+
+   private:
+    struct node {
+        using children_type = std::unordered_map<
+            string_view, std::unique_ptr<node>, boost::hash<string_view>>;
+
+        node() = default;
+        node(std::string l, node* p) : level(std::move(l)), parent(p) {}
+
+        bool has_children() const {
+            return plus || hash || !children.empty();
+        }
+
+        std::string level;
+        node* parent{nullptr};
+
+        // the children keys are views of the child level
+        children_type children;
+        std::unique_ptr<node> plus;
+        std::unique_ptr<node> hash;
+
+        bool has_value{false};
+        Value value{};
+    };
+
+    // splits the first level out of rest, returns false on the last level
+    static bool next_level(string_view& rest, string_view& level);
+
+    node* find(string_view filter);
+    void prune(node* n);
+
+    template <typename Function>
+    static void match(node const& n, string_view rest, bool end,
+                      Function& f);
+
+    node root_;
+};
+
+template <typename Value>
+bool topic_tree<Value>::next_level(string_view& rest, string_view& level) {
+    auto pos = rest.find('/');
+    if (pos == string_view::npos) {
+        level = rest;
+        rest.clear();
+        return false;
+    }
+    level = rest.substr(0, pos);
+    rest.remove_prefix(pos + 1);
+    return true;
+}
+
+template <typename Value>
+bool topic_tree<Value>::insert(string_view filter, Value value) {
+    auto n = &root_;
+    string_view level;
+    auto more = true;
+    while (more) {
+        more = next_level(filter, level);
+
+        std::unique_ptr<node>* child;
+        if (level == "+") {
+            child = &n->plus;
+        } else if (level == "#") {
+            child = &n->hash;
+        } else {
+            auto it = n->children.find(level);
+            if (it != n->children.end()) {
+                n = it->second.get();
+                continue;
+            }
+            std::unique_ptr<node> c{new node{level.to_string(), n}};
+            auto key = string_view{c->level};
+            n = n->children.emplace(key, std::move(c)).first->second.get();
+            continue;
+        }
+
+        if (!*child) {
+            child->reset(new node{level.to_string(), n});
+        }
+        n = child->get();
+    }
+
+    if (n->has_value) {
+        return false;
+    }
+    n->has_value = true;
+    n->value = std::move(value);
+    return true;
+}
+
+template <typename Value>
+bool topic_tree<Value>::erase(string_view filter) {
+    auto n = find(filter);
+    if (!n || !n->has_value) {
+        return false;
+    }
+    n->has_value = false;
+    n->value = Value{};
+    prune(n);
+    return true;
+}
+
+template <typename Value>
+auto topic_tree<Value>::find(string_view filter) -> node* {
+    auto n = &root_;
+    string_view level;
+    auto more = true;
+    while (more && n) {
+        more = next_level(filter, level);
+        if (level == "+") {
+            n = n->plus.get();
+        } else if (level == "#") {
+            n = n->hash.get();
+        } else {
+            auto it = n->children.find(level);
+            n = it != n->children.end() ? it->second.get() : nullptr;
+        }
+    }
+    return n;
+}
+
+template <typename Value>
+void topic_tree<Value>::prune(node* n) {
+    // removes the branch up to the first node still in use
+    while (n->parent && !n->has_value && !n->has_children()) {
+        auto parent = n->parent;
+        if (parent->plus.get() == n) {
+            parent->plus.reset();
+        } else if (parent->hash.get() == n) {
+            parent->hash.reset();
+        } else {
+            parent->children.erase(parent->children.find(n->level));
+        }
+        n = parent;
+    }
+}
+
+template <typename Value>
+template <typename Function>
+void topic_tree<Value>::match(string_view topic, Function&& f) const {
+    // topics starting with '$' are not matched by a leading wildcard
+    if (!topic.empty() && topic.front() == '$') {
+        string_view level;
+        auto more = next_level(topic, level);
+        auto it = root_.children.find(level);
+        if (it != root_.children.end()) {
+            match(*it->second, topic, !more, f);
+        }
+        return;
+    }
+    match(root_, topic, false, f);
+}
+
+template <typename Value>
+template <typename Function>
+void topic_tree<Value>::match(node const& n, string_view rest, bool end,
+                              Function& f) {
+    // '#' also matches the parent level
+    if (n.hash && n.hash->has_value) {
+        f(n.hash->value);
+    }
+
+    if (end) {
+        if (n.has_value) {
+            f(n.value);
+        }
+        return;
+    }
+
+    string_view level;
+    auto more = next_level(rest, level);
+
+    auto it = n.children.find(level);
+    if (it != n.children.end()) {
+        match(*it->second, rest, !more, f);
+    }
+    if (n.plus) {
+        match(*n.plus, rest, !more, f);
+    }
+}
+
+}  // namespace mosquittoasio